@@ -0,0 +1,109 @@
+/**
+ * SpscQueue throughput next to the mutex based BlockingQueue, both bounded to the same capacity.
+ *
+ * usage: spsc_queue_bench [count]
+ *
+ * one thread:  try_push and try_pop in turn, the cost of an uncontended operation
+ * two threads: a producer pushes count values that a consumer pops
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <thread>
+
+#include "utils/BlockingQueue.h"
+#include "utils/SpscQueue.h"
+
+namespace {
+
+// runs of each measurement, the best one is reported
+constexpr int kRounds = 5;
+constexpr size_t kCapacity = 1024;
+
+double Elapsed(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+template<typename Queue>
+double RunOneThread(size_t count)
+{
+    Queue queue(kCapacity);
+    uint64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < count; i++)
+    {
+        queue.try_push(i);
+        uint64_t val = 0;
+        queue.try_pop(val);
+        sum += val;
+    }
+    double ns = Elapsed(start);
+    if (sum != count * (count - 1) / 2)
+    {
+        fprintf(stderr, "lost values\n");
+        exit(1);
+    }
+    return ns / count;
+}
+
+template<typename Queue>
+double RunTwoThreads(size_t count)
+{
+    Queue queue(kCapacity);
+    uint64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&queue, &sum, count](){
+        for (size_t i = 0; i < count; i++)
+        {
+            sum += queue.pop();
+        }
+    });
+    for (uint64_t i = 0; i < count; i++)
+    {
+        queue.push(i);
+    }
+    consumer.join();
+    double ns = Elapsed(start);
+    if (sum != count * (count - 1) / 2)
+    {
+        fprintf(stderr, "lost values\n");
+        exit(1);
+    }
+    return ns / count;
+}
+
+template<typename Queue>
+void Report(const char *name, size_t count)
+{
+    double one = 1e300;
+    double two = 1e300;
+    for (int i = 0; i < kRounds; i++)
+    {
+        one = std::min(one, RunOneThread<Queue>(count));
+        two = std::min(two, RunTwoThreads<Queue>(count));
+    }
+    printf("%-16s %12.2f %12.2f\n", name, one, two);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    size_t count = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 10000000;
+    if (count == 0)
+    {
+        fprintf(stderr, "usage: %s [count]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%lu values, best of %d runs, ns a push and pop on one thread, ns a value on two\n",
+           count, kRounds);
+    printf("%-16s %12s %12s\n", "queue", "one thread", "two threads");
+    Report<util::SpscQueue<uint64_t>>("spsc_queue", count);
+    Report<util::BlockingQueue<uint64_t>>("blocking_queue", count);
+    return 0;
+}
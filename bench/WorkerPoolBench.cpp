@@ -0,0 +1,234 @@
+/**
+ * compare the worker schedulers under skewed task sizes:
+ * a mutex based BlockingQueue, the lock-free shared MpmcQueue of WorkerPool
+ * and WorkStealingPool.
+ *
+ * usage: worker_pool_bench [threads] [tasks]
+ *
+ * flat:   all tasks are posted from outside the pool
+ * nested: tasks posted from outside post their children from inside the pool
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "utils/BlockingQueue.h"
+#include "utils/WorkerPool.h"
+#include "utils/WorkStealingPool.h"
+
+namespace {
+
+using Task = std::function<void()>;
+
+// children of a task of the nested workload
+constexpr size_t kFanout = 16;
+// runs of each measurement, the best one is reported
+constexpr int kRounds = 3;
+
+/**
+ * the pool before the lock-free queues: threads popping a mutex based BlockingQueue
+ */
+class BlockingQueuePool final
+{
+public:
+    explicit BlockingQueuePool(size_t threads)
+    {
+        for (size_t i = 0; i < threads; i++)
+        {
+            mThreads.emplace_back([this](){ Run(); });
+        }
+    }
+    ~BlockingQueuePool()
+    {
+        mQueue.interrupt();
+        for (auto &thread : mThreads)
+        {
+            thread.join();
+        }
+    }
+    BlockingQueuePool(const BlockingQueuePool&) = delete;
+    BlockingQueuePool& operator=(const BlockingQueuePool&) = delete;
+
+    bool Post(Task task)
+    {
+        mQueue.push(std::move(task));
+        return true;
+    }
+
+private:
+    void Run()
+    {
+        try
+        {
+            while (true)
+            {
+                mQueue.pop()();
+            }
+        }
+        catch (const util::interrupt_error&)
+        {
+        }
+    }
+
+    util::BlockingQueue<Task> mQueue;
+    std::vector<std::thread> mThreads;
+};
+
+/**
+ * counts finished tasks, the main thread waits for all of them
+ */
+class Latch
+{
+public:
+    explicit Latch(size_t count) : mCount(count) {}
+
+    void CountDown()
+    {
+        if (mCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mCondition.notify_all();
+        }
+    }
+
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this](){ return mCount.load(std::memory_order_acquire) == 0; });
+    }
+
+private:
+    std::atomic<size_t> mCount;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+};
+
+std::atomic<uint64_t> gSink{0};
+
+void Work(uint32_t size)
+{
+    uint64_t x = size;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    gSink.fetch_add(x, std::memory_order_relaxed);
+}
+
+/**
+ * loop iterations of each task: 90% small, 9% 30 times larger, 1% 1000 times larger.
+ * the few large tasks hold most of the work
+ */
+std::vector<uint32_t> MakeSizes(size_t count)
+{
+    constexpr uint32_t kSmall = 200;
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::vector<uint32_t> sizes(count);
+    for (auto &size : sizes)
+    {
+        int p = percent(random);
+        size = (p == 0) ? kSmall * 1000 : (p < 10) ? kSmall * 30 : kSmall;
+    }
+    return sizes;
+}
+
+template<typename Pool>
+void Post(Pool &pool, Task task)
+{
+    while (!pool.Post(task))
+    {
+        std::this_thread::yield();
+    }
+}
+
+template<typename Pool>
+double RunFlat(Pool &pool, const std::vector<uint32_t> &sizes)
+{
+    Latch latch(sizes.size());
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t size : sizes)
+    {
+        Post(pool, [size, &latch](){ Work(size); latch.CountDown(); });
+    }
+    latch.Wait();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+template<typename Pool>
+double RunNested(Pool &pool, const std::vector<uint32_t> &sizes)
+{
+    Latch latch(sizes.size());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t first = 0; first < sizes.size(); first += kFanout)
+    {
+        size_t last = std::min(first + kFanout, sizes.size());
+        Post(pool, [&pool, &sizes, &latch, first, last]()
+            {
+                for (size_t i = first + 1; i < last; i++)
+                {
+                    uint32_t size = sizes[i];
+                    Post(pool, [size, &latch](){ Work(size); latch.CountDown(); });
+                }
+                Work(sizes[first]);
+                latch.CountDown();
+            });
+    }
+    latch.Wait();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+template<typename Pool>
+void Report(const char *name, Pool &pool, const std::vector<uint32_t> &sizes)
+{
+    double flat = 1e300;
+    double nested = 1e300;
+    for (int i = 0; i < kRounds; i++)
+    {
+        flat = std::min(flat, RunFlat(pool, sizes));
+        nested = std::min(nested, RunNested(pool, sizes));
+    }
+    printf("%-16s %10.1f %10.1f\n", name, flat, nested);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    size_t threads = (argc > 1) ? strtoul(argv[1], nullptr, 10) : std::thread::hardware_concurrency();
+    size_t tasks = (argc > 2) ? strtoul(argv[2], nullptr, 10) : 200000;
+    if (threads == 0 || tasks == 0)
+    {
+        fprintf(stderr, "usage: %s [threads] [tasks]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<uint32_t> sizes = MakeSizes(tasks);
+    printf("%lu threads, %lu tasks, best of %d runs in ms\n", threads, tasks, kRounds);
+    printf("%-16s %10s %10s\n", "scheduler", "flat", "nested");
+
+    {
+        BlockingQueuePool pool(threads);
+        Report("blocking_queue", pool, sizes);
+    }
+    {
+        util::WorkerPool pool(threads, tasks, util::WorkerPool::Scheduler::SHARED_QUEUE);
+        Report("shared_queue", pool, sizes);
+    }
+    {
+        util::WorkStealingPool pool(threads, tasks);
+        Report("work_stealing", pool, sizes);
+    }
+    return 0;
+}
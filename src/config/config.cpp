@@ -1,8 +1,12 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <stdint.h>
+
+#include <cctype>
 
 #include <boost/filesystem.hpp>
+#include <boost/algorithm/string.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
 #include <boost/property_tree/json_parser.hpp>
@@ -16,6 +20,68 @@ static const std::string json_ext = ".json";
 static const std::string ini_ext = ".ini";
 static const std::string info_ext = ".info";
 
+// parse cpu list like "0-3,8,10"
+static bool parseCpuList(const std::string &cpu_list, std::vector<int> &cpus)
+{
+    cpus.clear();
+    std::vector<std::string> items;
+    boost::split(items, cpu_list, boost::is_any_of(","), boost::token_compress_on);
+    for (std::string item : items)
+    {
+        boost::trim(item);
+        if (item.empty())
+        {
+            continue;
+        }
+
+        try
+        {
+            std::string::size_type pos = item.find('-');
+            int first = std::stoi(item.substr(0, pos));
+            int last = (pos == std::string::npos) ? first : std::stoi(item.substr(pos + 1));
+            if (first < 0 || last < first)
+            {
+                return false;
+            }
+            for (int cpu = first; cpu <= last; cpu++)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// parse a non-negative integer. ptree.get<std::size_t> would wrap "-1" around to SIZE_MAX
+static bool parseSize(const std::string &text, std::size_t &value)
+{
+    std::string number = boost::trim_copy(text);
+    if (number.empty() || !std::isdigit(static_cast<unsigned char>(number[0])))
+    {
+        return false;
+    }
+
+    try
+    {
+        std::size_t pos = 0;
+        unsigned long long result = std::stoull(number, &pos);
+        if (pos != number.size() || result > SIZE_MAX)
+        {
+            return false;
+        }
+        value = static_cast<std::size_t>(result);
+    }
+    catch (const std::exception &e)
+    {
+        return false;
+    }
+    return true;
+}
+
 bool Config::load(const std::string& config_file)
 {
     m_config_file = config_file;
@@ -60,6 +126,54 @@ bool Config::load(const std::string& config_file)
     m_pid_file = ptree.get("pid_file", "framework.pid");
     m_server_ip = ptree.get("server.ip", "0.0.0.0");
     m_server_port = ptree.get("server.port", "10000");
+    m_server_io_context_policy = ptree.get("server.io_context_policy", "round_robin");
+    m_server_reuse_port = ptree.get("server.reuse_port", false);
+    m_server_numa_policy = ptree.get("server.numa_policy", "none");
+    m_server_worker_scheduler = ptree.get("server.worker_scheduler", "shared_queue");
+
+    // numbers of things, sizes and seconds
+    const struct
+    {
+        const char *path;
+        std::size_t default_value;
+        std::size_t Config::*member;
+    } size_options[] = {
+        {"log_flush_bytes",                     64 * 1024, &Config::m_log_flush_bytes},
+        {"log_flush_interval",                  1000, &Config::m_log_flush_interval},
+        {"server.threads",                      0, &Config::m_server_threads},
+        {"server.read_buffer_size",             16 * 1024, &Config::m_server_read_buffer_size},
+        {"server.read_buffer_high_water",       1024 * 1024, &Config::m_server_read_buffer_high_water},
+        {"server.max_body_size",                64 * 1024 * 1024, &Config::m_server_max_body_size},
+        {"server.max_pending_responses",        64, &Config::m_server_max_pending_responses},
+        {"server.worker_threads",               0, &Config::m_server_worker_threads},
+        {"server.worker_queue_size",            4096, &Config::m_server_worker_queue_size},
+        {"server.write_batch_bytes",            1024 * 1024, &Config::m_server_write_batch_bytes},
+        {"server.write_batch_buffers",          64, &Config::m_server_write_batch_buffers},
+        {"server.header_timeout",               10, &Config::m_server_header_timeout},
+        {"server.body_timeout",                 30, &Config::m_server_body_timeout},
+        {"server.idle_timeout",                 60, &Config::m_server_idle_timeout},
+        {"server.write_timeout",                60, &Config::m_server_write_timeout},
+        {"server.linger_timeout",               5, &Config::m_server_linger_timeout},
+        {"server.max_requests_per_connection",  1000, &Config::m_server_max_requests_per_connection},
+        {"server.access_log_sample",            1, &Config::m_server_access_log_sample},
+        {"server.access_log_rate_limit",        1000, &Config::m_server_access_log_rate_limit},
+    };
+    for (const auto &option : size_options)
+    {
+        std::string text = ptree.get(option.path, std::to_string(option.default_value));
+        if (!parseSize(text, this->*option.member))
+        {
+            printf("invalid %s %s, expect a non-negative integer", option.path, text.c_str());
+            return false;
+        }
+    }
+
+    std::string cpus = ptree.get("server.cpus", "");
+    if (!parseCpuList(cpus, m_server_cpus))
+    {
+        printf("invalid server.cpus %s", cpus.c_str());
+        return false;
+    }
 
     return true;
 }
@@ -2,6 +2,7 @@
 #define _CONFIG_H_
 
 #include <string>
+#include <vector>
 
 namespace config {
 
@@ -17,9 +18,33 @@ public:
     bool load(const std::string& config_file);
 
     std::string getLogFile() const {return m_log_file;}
+    std::size_t getLogFlushBytes() const {return m_log_flush_bytes;}
+    std::size_t getLogFlushInterval() const {return m_log_flush_interval;}
     std::string getPidFile() const {return m_pid_file;}
     std::string getServerIp() const {return m_server_ip;}
     std::string getServerPort() const {return m_server_port;}
+    std::string getServerIoContextPolicy() const {return m_server_io_context_policy;}
+    bool getServerReusePort() const {return m_server_reuse_port;}
+    std::size_t getServerThreads() const {return m_server_threads;}
+    std::vector<int> getServerCpus() const {return m_server_cpus;}
+    std::string getServerNumaPolicy() const {return m_server_numa_policy;}
+    std::size_t getServerReadBufferSize() const {return m_server_read_buffer_size;}
+    std::size_t getServerReadBufferHighWater() const {return m_server_read_buffer_high_water;}
+    std::size_t getServerMaxBodySize() const {return m_server_max_body_size;}
+    std::size_t getServerMaxPendingResponses() const {return m_server_max_pending_responses;}
+    std::size_t getServerWorkerThreads() const {return m_server_worker_threads;}
+    std::size_t getServerWorkerQueueSize() const {return m_server_worker_queue_size;}
+    std::string getServerWorkerScheduler() const {return m_server_worker_scheduler;}
+    std::size_t getServerWriteBatchBytes() const {return m_server_write_batch_bytes;}
+    std::size_t getServerWriteBatchBuffers() const {return m_server_write_batch_buffers;}
+    std::size_t getServerHeaderTimeout() const {return m_server_header_timeout;}
+    std::size_t getServerBodyTimeout() const {return m_server_body_timeout;}
+    std::size_t getServerIdleTimeout() const {return m_server_idle_timeout;}
+    std::size_t getServerWriteTimeout() const {return m_server_write_timeout;}
+    std::size_t getServerLingerTimeout() const {return m_server_linger_timeout;}
+    std::size_t getServerMaxRequestsPerConnection() const {return m_server_max_requests_per_connection;}
+    std::size_t getServerAccessLogSample() const {return m_server_access_log_sample;}
+    std::size_t getServerAccessLogRateLimit() const {return m_server_access_log_rate_limit;}
 
     // delete copy and move constructors and assign operators
     Config(const Config&) = delete;
@@ -34,9 +59,33 @@ private:
 private:
     std::string m_config_file;
     std::string m_log_file;
+    std::size_t m_log_flush_bytes = 0;
+    std::size_t m_log_flush_interval = 0;
     std::string m_pid_file;
     std::string m_server_ip;
     std::string m_server_port;
+    std::string m_server_io_context_policy;
+    bool m_server_reuse_port = false;
+    std::size_t m_server_threads = 0;
+    std::vector<int> m_server_cpus;
+    std::string m_server_numa_policy;
+    std::size_t m_server_read_buffer_size = 0;
+    std::size_t m_server_read_buffer_high_water = 0;
+    std::size_t m_server_max_body_size = 0;
+    std::size_t m_server_max_pending_responses = 0;
+    std::size_t m_server_worker_threads = 0;
+    std::size_t m_server_worker_queue_size = 0;
+    std::string m_server_worker_scheduler;
+    std::size_t m_server_write_batch_bytes = 0;
+    std::size_t m_server_write_batch_buffers = 0;
+    std::size_t m_server_header_timeout = 0;
+    std::size_t m_server_body_timeout = 0;
+    std::size_t m_server_idle_timeout = 0;
+    std::size_t m_server_write_timeout = 0;
+    std::size_t m_server_linger_timeout = 0;
+    std::size_t m_server_max_requests_per_connection = 0;
+    std::size_t m_server_access_log_sample = 0;
+    std::size_t m_server_access_log_rate_limit = 0;
 };
 
 }
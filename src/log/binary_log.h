@@ -0,0 +1,440 @@
+#ifndef _BINARY_LOG_H_
+#define _BINARY_LOG_H_
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+namespace logger {
+namespace detail {
+
+/**
+ * how an argument is stored in a record, a type byte and the value
+ */
+enum arg_type : uint8_t
+{
+    int_arg,     // int64_t
+    uint_arg,    // uint64_t
+    double_arg,  // double
+    string_arg,  // uint32_t length, the characters and a '\0'
+    pointer_arg  // const void*
+};
+
+enum record_kind : uint32_t
+{
+    log_record,
+    filler_record  // unused space at the end of the ring
+};
+
+/**
+ * fixed part of a record, the encoded arguments follow it.
+ * file and format are string literals, so only their addresses are stored
+ */
+struct record_header
+{
+    uint32_t size;  // of the whole record, a multiple of 8
+    uint32_t kind;
+    const char *file;
+    const char *format;
+    int64_t time;   // nanoseconds since the epoch of the system clock
+    int32_t line;
+    uint8_t level;
+    uint8_t arg_count;
+};
+
+/**
+ * byte ring written by one thread and read by the log thread, without locks.
+ * each side caches the other side's index, like util::SpscQueue
+ */
+class log_buffer
+{
+public:
+    /**
+     * @param capacity a power of two
+     */
+    log_buffer(size_t capacity, uintmax_t thread_id)
+        : m_capacity(capacity),
+          m_mask(capacity - 1),
+          m_data(new char[capacity]),
+          m_thread_id(thread_id)
+    {
+    }
+    log_buffer(const log_buffer&) = delete;
+    log_buffer& operator=(const log_buffer&) = delete;
+
+    /**
+     * writer only, contiguous space for size bytes or nullptr if the ring is full
+     */
+    char* reserve(size_t size)
+    {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t offset = tail & m_mask;
+        size_t contiguous = m_capacity - offset;
+        size_t needed = (size <= contiguous) ? size : contiguous + size;
+        if (tail + needed - m_head_cache > m_capacity)
+        {
+            m_head_cache = m_head.load(std::memory_order_acquire);
+            if (tail + needed - m_head_cache > m_capacity)
+            {
+                return nullptr;
+            }
+        }
+
+        if (size > contiguous)
+        {
+            // records never wrap, skip the end of the ring
+            record_header *filler = reinterpret_cast<record_header*>(&m_data[offset]);
+            filler->size = static_cast<uint32_t>(contiguous);
+            filler->kind = filler_record;
+            m_tail.store(tail + contiguous, std::memory_order_release);
+            return &m_data[0];
+        }
+        return &m_data[offset];
+    }
+
+    /**
+     * writer only, publish the reserved record
+     */
+    void commit(size_t size)
+    {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + size, std::memory_order_release);
+    }
+
+    /**
+     * writer only, count a record that did not fit
+     */
+    void drop()
+    {
+        m_dropped.store(m_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * reader only, the oldest record or nullptr if there is none
+     */
+    const record_header* front()
+    {
+        while (true)
+        {
+            if (m_read == m_tail_cache)
+            {
+                m_tail_cache = m_tail.load(std::memory_order_acquire);
+                if (m_read == m_tail_cache)
+                {
+                    return nullptr;
+                }
+            }
+
+            const record_header *header = reinterpret_cast<const record_header*>(&m_data[m_read & m_mask]);
+            if (header->kind == log_record)
+            {
+                return header;
+            }
+            m_read += header->size;
+        }
+    }
+
+    /**
+     * reader only, the space of the popped records is handed back by release
+     */
+    void pop()
+    {
+        m_read += reinterpret_cast<const record_header*>(&m_data[m_read & m_mask])->size;
+    }
+
+    void release()
+    {
+        m_head.store(m_read, std::memory_order_release);
+    }
+
+    bool empty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+    uint64_t dropped() const
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+    uintmax_t thread_id() const
+    {
+        return m_thread_id;
+    }
+
+    /**
+     * the writer thread has exited, the buffer can go once it is empty
+     */
+    std::atomic<bool> retired{false};
+
+    /// drops already reported by the reader
+    uint64_t reported = 0;
+
+private:
+    const size_t m_capacity;
+    const size_t m_mask;
+    std::unique_ptr<char[]> m_data;
+    const uintmax_t m_thread_id;
+
+    alignas(64) std::atomic<uint64_t> m_tail{0};
+    uint64_t m_head_cache = 0;
+    std::atomic<uint64_t> m_dropped{0};
+
+    alignas(64) std::atomic<uint64_t> m_head{0};
+    uint64_t m_tail_cache = 0;
+    uint64_t m_read = 0;
+};
+
+/**
+ * buffer of the calling thread, nullptr until the thread logs for the first time
+ * and again once the thread exits
+ */
+inline thread_local log_buffer *t_log_buffer = nullptr;
+
+/**
+ * create and register the buffer of the calling thread, nullptr if the records of
+ * this thread should be written directly
+ */
+log_buffer* register_thread();
+
+/**
+ * true while the log thread is parked, the next record wakes it
+ */
+inline std::atomic<bool> g_log_thread_parked{false};
+
+void wake_log_thread();
+
+/**
+ * format and write a record right away, used when there is no buffer
+ */
+void write_direct(const record_header &header);
+
+inline log_buffer* thread_buffer()
+{
+    log_buffer *buffer = t_log_buffer;
+    return (buffer != nullptr) ? buffer : register_thread();
+}
+
+/**
+ * false if a %s conversion of format has a precision. the record copies a char* argument
+ * up to its '\0', a precision can't stop it at the end of an unterminated buffer,
+ * pass a std::string_view instead. evaluated at compile time by the LOG_* macros
+ */
+constexpr bool check_format(const char *format)
+{
+    for (const char *p = format; *p != '\0'; p++)
+    {
+        if (*p != '%')
+        {
+            continue;
+        }
+        p++;
+        if (*p == '%')
+        {
+            continue;
+        }
+
+        bool precision = false;
+        while (*p != '\0' && (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' ||
+                              *p == '*' || *p == '.' || (*p >= '1' && *p <= '9') ||
+                              *p == 'h' || *p == 'l' || *p == 'L' || *p == 'q' ||
+                              *p == 'j' || *p == 'z' || *p == 't'))
+        {
+            precision = precision || (*p == '.');
+            p++;
+        }
+        if (*p == '\0')
+        {
+            break;
+        }
+        if (*p == 's' && precision)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * a long string argument is cut, like the old 4K message buffer did
+ */
+static constexpr size_t max_string_arg = 4096;
+
+struct string_arg_ref
+{
+    const char *data;
+    size_t size;
+};
+
+// printf arguments are normalized to the few stored types
+
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, int64_t>::type
+to_arg(T value)
+{
+    return value;
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value, uint64_t>::type
+to_arg(T value)
+{
+    return value;
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_enum<T>::value, int64_t>::type
+to_arg(T value)
+{
+    return static_cast<int64_t>(value);
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value, double>::type
+to_arg(T value)
+{
+    return static_cast<double>(value);
+}
+
+template<typename T>
+inline const void* to_arg(T *value)
+{
+    return value;
+}
+
+inline const void* to_arg(std::nullptr_t)
+{
+    return nullptr;
+}
+
+inline string_arg_ref to_arg(const char *value)
+{
+    if (value == nullptr)
+    {
+        return string_arg_ref{"(null)", 6};
+    }
+    return string_arg_ref{value, strnlen(value, max_string_arg)};
+}
+
+inline string_arg_ref to_arg(char *value)
+{
+    return to_arg(static_cast<const char*>(value));
+}
+
+inline string_arg_ref to_arg(std::string_view value)
+{
+    return string_arg_ref{value.data(), std::min(value.size(), max_string_arg)};
+}
+
+inline string_arg_ref to_arg(const std::string &value)
+{
+    return string_arg_ref{value.data(), std::min(value.size(), max_string_arg)};
+}
+
+template<typename T>
+inline size_t encoded_size(const T&)
+{
+    return 1 + sizeof(T);
+}
+
+inline size_t encoded_size(const string_arg_ref &value)
+{
+    return 1 + sizeof(uint32_t) + value.size + 1;
+}
+
+template<typename T>
+inline char* encode_arg(char *out, arg_type type, const T &value)
+{
+    *out++ = static_cast<char>(type);
+    memcpy(out, &value, sizeof(T));
+    return out + sizeof(T);
+}
+
+inline char* encode_arg(char *out, int64_t value)
+{
+    return encode_arg(out, int_arg, value);
+}
+
+inline char* encode_arg(char *out, uint64_t value)
+{
+    return encode_arg(out, uint_arg, value);
+}
+
+inline char* encode_arg(char *out, double value)
+{
+    return encode_arg(out, double_arg, value);
+}
+
+inline char* encode_arg(char *out, const void *value)
+{
+    return encode_arg(out, pointer_arg, value);
+}
+
+inline char* encode_arg(char *out, const string_arg_ref &value)
+{
+    out = encode_arg(out, string_arg, static_cast<uint32_t>(value.size));
+    memcpy(out, value.data, value.size);
+    out[value.size] = '\0';
+    return out + value.size + 1;
+}
+
+template<typename... Args>
+inline void write_record(int level, const char *file, int line, const char *format, const Args&... args)
+{
+    size_t size = (sizeof(record_header) + ... + encoded_size(args));
+    size = (size + 7) & ~size_t(7);
+
+    log_buffer *buffer = thread_buffer();
+    std::unique_ptr<char[]> local;
+    char *record = (buffer != nullptr) ? buffer->reserve(size) : nullptr;
+    if (record == nullptr)
+    {
+        if (buffer != nullptr)
+        {
+            buffer->drop();
+            return;
+        }
+        local.reset(new char[size]);
+        record = local.get();
+    }
+
+    record_header *header = new (record) record_header;
+    header->size = static_cast<uint32_t>(size);
+    header->kind = log_record;
+    header->file = file;
+    header->format = format;
+    header->time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::system_clock::now().time_since_epoch()).count();
+    header->line = line;
+    header->level = static_cast<uint8_t>(level);
+    header->arg_count = static_cast<uint8_t>(sizeof...(args));
+
+    char *out = record + sizeof(record_header);
+    ((out = encode_arg(out, args)), ...);
+    (void)out;
+
+    if (buffer != nullptr)
+    {
+        buffer->commit(size);
+        if (g_log_thread_parked.load(std::memory_order_relaxed))
+        {
+            wake_log_thread();
+        }
+    }
+    else
+    {
+        write_direct(*header);
+    }
+}
+
+} // namespace detail
+} // namespace logger
+
+#endif // _BINARY_LOG_H_
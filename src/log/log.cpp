@@ -4,7 +4,13 @@
 #include <string.h>
 #include <stdarg.h>
 #include <iostream>
-#include <array>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <sstream>
+#include <unordered_map>
 
 #include <boost/smart_ptr/shared_ptr.hpp>
 #include <boost/core/null_deleter.hpp>
@@ -16,6 +22,8 @@
 #include <boost/log/sinks.hpp>
 #include <boost/log/utility/setup.hpp>
 #include <boost/log/support/date_time.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/date_time/c_local_time_adjustor.hpp>
 #include <boost/filesystem.hpp>
 
 
@@ -31,10 +39,17 @@ namespace logger {
 static std::string log_file_name_suffix;
 static size_t log_file_rotation_size; /**< log file rotation size, unit M */
 //g++ -g -DBOOST_LOG_DYN_LINK -lboost_thread -lboost_system -lboost_log -lboost_log_setup -lpthread log.cpp -o log
-static const size_t record_queue_limit = 100000;
+static const size_t thread_buffer_size = 1024 * 1024;
+static const size_t drain_limit = 4096; /**< records of one buffer written in a pass */
+static const int64_t max_park_time = 1000; /**< unit ms, bounds the delay of a missed wake up */
 
 static boost::shared_ptr< sinks::synchronous_sink< sinks::text_ostream_backend > > g_console_sink;
 
+static std::atomic<size_t> g_flush_bytes(64 * 1024);
+static std::atomic<size_t> g_flush_interval(1000); /**< unit ms */
+
+std::atomic<int> g_log_level(trace);
+
 BOOST_LOG_GLOBAL_LOGGER_INIT(my_logger, src::severity_logger_mt)
 {
     src::severity_logger_mt<severity_level> lg;
@@ -50,6 +65,7 @@ BOOST_LOG_ATTRIBUTE_KEYWORD(severity, "Severity", severity_level)
 
 BOOST_LOG_ATTRIBUTE_KEYWORD(process_id, "ProcessID", attrs::current_process_id::value_type)
 BOOST_LOG_ATTRIBUTE_KEYWORD(thread_id, "ThreadID", attrs::current_thread_id::value_type)
+BOOST_LOG_ATTRIBUTE_KEYWORD(time_stamp, "TimeStamp", boost::posix_time::ptime)
 //BOOST_LOG_ATTRIBUTE_KEYWORD(scope, "Scope", attrs::named_scope::value_type)
 
 // The formatting logic for the severity level
@@ -73,8 +89,102 @@ inline std::basic_ostream< CharT, TraitsT >& operator<< (
     return strm;
 }
 
+/**
+ * text of the last second and of the process and thread ids, kept by each formatting thread
+ */
+struct line_format_cache
+{
+    int64_t second = -1;
+    std::string time_prefix; // "[2020-01-01 00:00:00."
+    std::string process_id;
+    std::unordered_map< uintmax_t, std::string > thread_ids;
+};
+
+/**
+ * "[time] [severity] [pid:x tid:y]: message", the same line as the format
+ * expressions of the sinks. only the sub-second digits are formatted for each record
+ */
+static void format_line(logging::record_view const& rec, logging::formatting_ostream& strm)
+{
+    static const char* const severity_names[] = {"trace", "debug", "info", "warn", "error", "fatal"};
+    thread_local line_format_cache cache;
+
+    auto ts = rec[time_stamp];
+    if (ts)
+    {
+        const boost::posix_time::ptime &time = ts.get();
+        const boost::posix_time::time_duration time_of_day = time.time_of_day();
+        int64_t second = static_cast<int64_t>(time.date().day_number()) * 86400 + time_of_day.total_seconds();
+        if (second != cache.second)
+        {
+            cache.second = second;
+            boost::gregorian::date::ymd_type ymd = time.date().year_month_day();
+            char prefix[32];
+            snprintf(prefix, sizeof(prefix), "[%04d-%02d-%02d %02d:%02d:%02d.",
+                     static_cast<int>(ymd.year), static_cast<int>(ymd.month), static_cast<int>(ymd.day),
+                     static_cast<int>(time_of_day.hours()), static_cast<int>(time_of_day.minutes()),
+                     static_cast<int>(time_of_day.seconds()));
+            cache.time_prefix = prefix;
+        }
+
+        int64_t microseconds = time_of_day.fractional_seconds() * 1000000 /
+                               boost::posix_time::time_duration::ticks_per_second();
+        char digits[8] = "000000]";
+        for (int i = 5; i >= 0; i--)
+        {
+            digits[i] = static_cast<char>('0' + microseconds % 10);
+            microseconds /= 10;
+        }
+        strm << cache.time_prefix;
+        strm.write(digits, 7);
+    }
+    else
+    {
+        strm << "[]";
+    }
+
+    strm << " [";
+    auto level = rec[severity];
+    if (level && static_cast<std::size_t>(level.get()) < (sizeof(severity_names) / sizeof(*severity_names)))
+    {
+        strm << severity_names[level.get()];
+    }
+    strm << "] [pid:";
+
+    if (cache.process_id.empty())
+    {
+        auto pid = rec[process_id];
+        if (pid)
+        {
+            std::ostringstream ss;
+            ss << pid.get();
+            cache.process_id = ss.str();
+        }
+    }
+    strm << cache.process_id << " tid:";
+
+    auto tid = rec[thread_id];
+    if (tid)
+    {
+        if (cache.thread_ids.size() > 1024)
+        {
+            cache.thread_ids.clear();
+        }
+        std::string &text = cache.thread_ids[tid.get().native_id()];
+        if (text.empty())
+        {
+            std::ostringstream ss;
+            ss << tid.get();
+            text = ss.str();
+        }
+        strm << text;
+    }
+    strm << "]: " << rec[expr::smessage];
+}
+
 void set_log_level(severity_level level)
 {
+    g_log_level.store(level, std::memory_order_relaxed);
     logging::core::get()->set_filter(severity >= level);
 }
 
@@ -97,20 +207,7 @@ void open_console_log()
     // The backend requires synchronization in the frontend.
     typedef sinks::synchronous_sink< sinks::text_ostream_backend > sink_t;
     boost::shared_ptr< sink_t > sink(new sink_t(backend));
-    sink->set_formatter
-        (
-            expr::stream
-            << "["
-            << expr::format_date_time< boost::posix_time::ptime >("TimeStamp", "%Y-%m-%d %H:%M:%S.%f")
-            << "]"
-            << " ["
-            << expr::attr< severity_level >("Severity")
-            << "]"
-            << " [pid:"
-            << process_id << " tid:" << thread_id
-            << "]: "
-            << expr::smessage
-            );
+    sink->set_formatter(&format_line);
 
     boost::shared_ptr< logging::core > core = logging::core::get();
     core->add_sink(sink);
@@ -120,9 +217,125 @@ void open_console_log()
 
 void close_console_log()
 {
+    flush_log();
     logging::core::get()->remove_sink(g_console_sink);
 }
 
+void set_file_log_flush(size_t flush_bytes, size_t flush_interval)
+{
+    g_flush_bytes.store(flush_bytes, std::memory_order_relaxed);
+    g_flush_interval.store(flush_interval, std::memory_order_relaxed);
+}
+
+/**
+ * collects formatted records and hands them to the text file backend in one large write,
+ * when flush_bytes are collected, flush_interval has passed or an error record comes
+ */
+class batched_file_backend :
+    public sinks::basic_formatted_sink_backend<
+        char, sinks::combine_requirements< sinks::synchronized_feeding, sinks::flushing >::type >
+{
+public:
+    explicit batched_file_backend(boost::shared_ptr< sinks::text_file_backend > file)
+        : m_file(file),
+          m_last_write(std::chrono::steady_clock::now())
+    {
+    }
+
+    void consume(logging::record_view const& rec, string_type const& formatted_message)
+    {
+        m_batch.append(formatted_message).append(1, '\n');
+        m_last_record = rec;
+
+        auto level = rec[severity];
+        if ((level && level.get() >= error) ||
+            m_batch.size() >= g_flush_bytes.load(std::memory_order_relaxed) ||
+            write_due())
+        {
+            write_batch();
+        }
+    }
+
+    void flush()
+    {
+        write_batch();
+    }
+
+    /**
+     * how long the log thread may park before the batch is due
+     */
+    std::chrono::milliseconds time_to_write() const
+    {
+        std::chrono::milliseconds wait(max_park_time);
+        if (!m_batch.empty())
+        {
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                               std::chrono::steady_clock::now() - m_last_write);
+            auto interval = std::chrono::milliseconds(g_flush_interval.load(std::memory_order_relaxed));
+            wait = std::min(wait, std::max(interval - elapsed, std::chrono::milliseconds(0)));
+        }
+        return wait;
+    }
+
+    void flush_if_due()
+    {
+        if (!m_batch.empty() && write_due())
+        {
+            write_batch();
+        }
+    }
+
+private:
+    bool write_due() const
+    {
+        return std::chrono::steady_clock::now() - m_last_write >=
+               std::chrono::milliseconds(g_flush_interval.load(std::memory_order_relaxed));
+    }
+
+    void write_batch()
+    {
+        m_last_write = std::chrono::steady_clock::now();
+        if (m_batch.empty())
+        {
+            return;
+        }
+        // the file backend appends the last newline itself
+        m_batch.pop_back();
+        m_file->consume(m_last_record, m_batch);
+        m_batch.clear();
+        m_last_record = logging::record_view();
+    }
+
+    boost::shared_ptr< sinks::text_file_backend > m_file;
+    std::string m_batch;
+    logging::record_view m_last_record; // the file backend wants a record with the text
+    std::chrono::steady_clock::time_point m_last_write;
+};
+
+typedef sinks::synchronous_sink< batched_file_backend > file_sink_t;
+
+// set by init_log, read by the log thread
+static boost::shared_ptr< file_sink_t > g_file_sink;
+
+static void flush_file_log_if_due()
+{
+    boost::shared_ptr< file_sink_t > sink = boost::atomic_load(&g_file_sink);
+    if (sink)
+    {
+        sink->locked_backend()->flush_if_due();
+    }
+}
+
+static std::chrono::milliseconds file_log_wait_time()
+{
+    boost::shared_ptr< file_sink_t > sink = boost::atomic_load(&g_file_sink);
+    if (sink)
+    {
+        return sink->locked_backend()->time_to_write();
+    }
+    return std::chrono::milliseconds(max_park_time);
+}
+
 static void add_file_log(const std::string& log_file_name)
 {
     /*
@@ -143,35 +356,22 @@ static void add_file_log(const std::string& log_file_name)
             keywords::time_based_rotation = sinks::file::rotation_at_time_point(0, 0, 0)
             );
 
+    // every write is a whole batch
     backend->auto_flush(true);
     backend->set_open_mode(std::ios_base::app | std::ios_base::ate);
 
     // Wrap it into the frontend and register in the core.
-    typedef sinks::asynchronous_sink<
-                    sinks::text_file_backend,
-                    sinks::bounded_fifo_queue<
-                            record_queue_limit,
-                            sinks::drop_on_overflow>
-            > sink_t;
-
-    boost::shared_ptr< sink_t > sink(new sink_t(backend));
+    // records come from the log thread, the sink needs no queue of its own
+    boost::shared_ptr< file_sink_t > sink(new file_sink_t(boost::make_shared< batched_file_backend >(backend)));
 
-    sink->set_formatter
-        (
-            expr::format("[%1%] [%2%] [pid:%3% tid:%4%]: %5%")
-            % expr::format_date_time< boost::posix_time::ptime >("TimeStamp", "%Y-%m-%d %H:%M:%S.%f")
-            % severity
-            //% expr::format_named_scope("Scopes", keywords::format = "%F:%l")
-            % process_id
-            % thread_id
-            % expr::smessage
-            );
+    sink->set_formatter(&format_line);
 
     // trace <= level < fatal
     sink->set_filter(expr::is_in_range(severity, trace, fatal));
 
     boost::shared_ptr< logging::core > core = logging::core::get();
     core->add_sink(sink);
+    boost::atomic_store(&g_file_sink, sink);
 }
 
 /**
@@ -187,7 +387,7 @@ static void add_error_log(const std::string& log_file_name)
             keywords::time_based_rotation = sinks::file::rotation_at_time_point(0, 0, 0),
             keywords::auto_flush = true,
             keywords::filter = severity == fatal,
-            keywords::format = "[%TimeStamp%] [%Severity%] [pid:%ProcessID% tid:%ThreadID%]: %Message%"
+            keywords::format = &format_line
             );
 }
 
@@ -210,16 +410,508 @@ void init_log(const std::string& log_file_name,
     set_log_level(log_level);
 }
 
-void write_log(severity_level level, const char *file, int line, const char *format, ...)
+static const char* base_name(const char *file)
 {
-    std::array<char, 4096> message_buffer;
+    const char *file_name = strrchr(file, '/');
+    return (file_name != nullptr) ? file_name + 1 : file;
+}
+
+static void append_format(std::string &out, const char *format, ...)
+{
+    char buffer[256];
     va_list args;
-    va_start (args, format);
-    vsnprintf(message_buffer.data(), message_buffer.size(), format, args);
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0)
+    {
+        return;
+    }
+    if (static_cast<size_t>(length) < sizeof(buffer))
+    {
+        out.append(buffer, length);
+        return;
+    }
+
+    size_t size = out.size();
+    out.resize(size + length + 1);
+    va_start(args, format);
+    vsnprintf(&out[size], length + 1, format, args);
     va_end(args);
+    out.resize(size + length);
+}
 
-    boost::filesystem::path p(file);
-    LOGGER(level) << p.filename().c_str() << ":" << line << " " << message_buffer.data();
+/**
+ * reads the encoded arguments of a record
+ */
+class arg_reader
+{
+public:
+    explicit arg_reader(const detail::record_header &header)
+        : m_data(reinterpret_cast<const char*>(&header) + sizeof(header)),
+          m_remain(header.arg_count)
+    {
+    }
+
+    bool empty() const
+    {
+        return m_remain == 0;
+    }
+
+    detail::arg_type type() const
+    {
+        return static_cast<detail::arg_type>(*m_data);
+    }
+
+    template<typename T>
+    T value()
+    {
+        T result;
+        memcpy(&result, m_data + 1, sizeof(T));
+        m_data += 1 + sizeof(T);
+        m_remain--;
+        return result;
+    }
+
+    const char* string()
+    {
+        uint32_t length = 0;
+        memcpy(&length, m_data + 1, sizeof(length));
+        const char *result = m_data + 1 + sizeof(length);
+        m_data = result + length + 1;
+        m_remain--;
+        return result;
+    }
+
+    int64_t integer()
+    {
+        switch (type())
+        {
+        case detail::int_arg:
+            return value<int64_t>();
+        case detail::uint_arg:
+            return static_cast<int64_t>(value<uint64_t>());
+        case detail::double_arg:
+            return static_cast<int64_t>(value<double>());
+        case detail::pointer_arg:
+            value<const void*>();
+            return 0;
+        default:
+            string();
+            return 0;
+        }
+    }
+
+private:
+    const char *m_data;
+    size_t m_remain;
+};
+
+/**
+ * printf the record, one conversion at a time. the length modifiers of the format
+ * are ignored, every argument is printed the way it was stored
+ */
+static void format_record(const detail::record_header &header, std::string &message)
+{
+    arg_reader args(header);
+    std::string spec;
+    const char *p = header.format;
+    while (*p != '\0')
+    {
+        if (*p != '%')
+        {
+            const char *next = strchr(p, '%');
+            size_t length = (next != nullptr) ? static_cast<size_t>(next - p) : strlen(p);
+            message.append(p, length);
+            p += length;
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            message += '%';
+            p += 2;
+            continue;
+        }
+
+        const char *start = p++;
+        spec.assign(1, '%');
+        while (*p != '\0' && strchr("-+ #0", *p) != nullptr)
+        {
+            spec += *p++;
+        }
+        // width and precision, '*' takes them from the arguments
+        for (int part = 0; part < 2; part++)
+        {
+            if (part == 1)
+            {
+                if (*p != '.')
+                {
+                    break;
+                }
+                spec += *p++;
+            }
+            if (*p == '*')
+            {
+                p++;
+                spec += std::to_string(args.empty() ? 0 : args.integer());
+            }
+            while (*p >= '0' && *p <= '9')
+            {
+                spec += *p++;
+            }
+        }
+        while (*p != '\0' && strchr("hlLqjzt", *p) != nullptr)
+        {
+            p++;
+        }
+        char conversion = *p;
+        if (conversion == '\0')
+        {
+            message.append(start);
+            break;
+        }
+        p++;
+
+        if (args.empty())
+        {
+            message.append(start, p - start);
+            continue;
+        }
+
+        bool floating = (strchr("fFeEgGaA", conversion) != nullptr);
+        switch (args.type())
+        {
+        case detail::int_arg:
+        case detail::uint_arg:
+        {
+            bool is_signed = (args.type() == detail::int_arg);
+            if (floating)
+            {
+                double value = is_signed ? static_cast<double>(args.value<int64_t>())
+                                         : static_cast<double>(args.value<uint64_t>());
+                append_format(message, (spec + conversion).c_str(), value);
+            }
+            else if (conversion == 'c')
+            {
+                int value = static_cast<int>(args.integer());
+                append_format(message, (spec + 'c').c_str(), value);
+            }
+            else if (strchr("ouxX", conversion) != nullptr)
+            {
+                unsigned long long value = args.integer();
+                append_format(message, (spec + "ll" + conversion).c_str(), value);
+            }
+            else if (is_signed)
+            {
+                long long value = args.value<int64_t>();
+                append_format(message, (spec + "lld").c_str(), value);
+            }
+            else
+            {
+                unsigned long long value = args.value<uint64_t>();
+                append_format(message, (spec + "llu").c_str(), value);
+            }
+            break;
+        }
+        case detail::double_arg:
+            append_format(message, (spec + (floating ? conversion : 'g')).c_str(), args.value<double>());
+            break;
+        case detail::string_arg:
+            append_format(message, (spec + 's').c_str(), args.string());
+            break;
+        case detail::pointer_arg:
+            append_format(message, (spec + 'p').c_str(), args.value<const void*>());
+            break;
+        }
+    }
+}
+
+/**
+ * writes the records of the buffers into the core from the log thread, with the
+ * time and thread id of the logging thread instead of the log thread's
+ */
+class record_writer
+{
+public:
+    record_writer()
+        : m_time_stamp(boost::posix_time::ptime()),
+          m_thread_id(attrs::current_thread_id::value_type())
+    {
+        // attributes of the logger take precedence over the global ones
+        m_logger.add_attribute("TimeStamp", m_time_stamp);
+        m_logger.add_attribute("ThreadID", m_thread_id);
+    }
+
+    void write(uintmax_t thread_id, const detail::record_header &header)
+    {
+        m_message.clear();
+        format_record(header, m_message);
+        set_attributes(thread_id, header.time);
+        BOOST_LOG_SEV(m_logger, static_cast<severity_level>(header.level))
+            << base_name(header.file) << ":" << header.line << " " << m_message;
+    }
+
+    void write_dropped(uintmax_t thread_id, uint64_t count)
+    {
+        set_attributes(thread_id, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::system_clock::now().time_since_epoch()).count());
+        BOOST_LOG_SEV(m_logger, warn) << count << " log records dropped, the log buffer of the thread is full";
+    }
+
+private:
+    void set_attributes(uintmax_t thread_id, int64_t time)
+    {
+        // the local time of the second is cached, records of one second share it
+        int64_t second = time / 1000000000;
+        if (second != m_second)
+        {
+            m_second = second;
+            m_second_time = boost::date_time::c_local_adjustor< boost::posix_time::ptime >::utc_to_local(
+                                boost::posix_time::from_time_t(static_cast<time_t>(second)));
+        }
+        m_time_stamp.set(m_second_time + boost::posix_time::microseconds((time % 1000000000) / 1000));
+        m_thread_id.set(attrs::current_thread_id::value_type(thread_id));
+    }
+
+    src::severity_logger< severity_level > m_logger;
+    attrs::mutable_constant< boost::posix_time::ptime > m_time_stamp;
+    attrs::mutable_constant< attrs::current_thread_id::value_type > m_thread_id;
+    std::string m_message;
+    int64_t m_second = -1;
+    boost::posix_time::ptime m_second_time;
+};
+
+/**
+ * the log thread and the buffers of the logging threads
+ */
+struct log_backend
+{
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable flushed;
+    std::vector< std::shared_ptr<detail::log_buffer> > buffers;
+    std::thread thread;
+    bool stop = false;
+    uint64_t flush_requested = 0;
+    uint64_t flush_done = 0;
+};
+
+// never destroyed, threads may log during static destruction
+static log_backend& backend()
+{
+    static log_backend *instance = new log_backend;
+    return *instance;
+}
+
+/**
+ * write the buffered records oldest first, so the threads interleave in time order
+ * @return false if records are left after the limit of a pass
+ */
+static bool drain_buffers(std::vector< std::shared_ptr<detail::log_buffer> > &buffers, record_writer &writer)
+{
+    size_t limit = drain_limit * buffers.size();
+    size_t count = 0;
+    while (count < limit)
+    {
+        detail::log_buffer *oldest = nullptr;
+        const detail::record_header *oldest_header = nullptr;
+        for (auto &buffer : buffers)
+        {
+            const detail::record_header *header = buffer->front();
+            if (header != nullptr && (oldest_header == nullptr || header->time < oldest_header->time))
+            {
+                oldest = buffer.get();
+                oldest_header = header;
+            }
+        }
+        if (oldest == nullptr)
+        {
+            break;
+        }
+
+        writer.write(oldest->thread_id(), *oldest_header);
+        oldest->pop();
+        // hand the space back now and then, the writers may be waiting for it
+        if (++count % 64 == 0)
+        {
+            oldest->release();
+        }
+    }
+
+    for (auto &buffer : buffers)
+    {
+        buffer->release();
+        uint64_t dropped = buffer->dropped();
+        if (dropped != buffer->reported)
+        {
+            writer.write_dropped(buffer->thread_id(), dropped - buffer->reported);
+            buffer->reported = dropped;
+        }
+    }
+    return count < limit;
+}
+
+static void run_backend(log_backend &state)
+{
+    record_writer writer;
+    std::vector< std::shared_ptr<detail::log_buffer> > buffers;
+    std::unique_lock<std::mutex> lock(state.mutex);
+    while (true)
+    {
+        bool stopping = state.stop;
+        uint64_t flush_target = state.flush_requested;
+        buffers = state.buffers;
+        lock.unlock();
+
+        bool drained = drain_buffers(buffers, writer);
+        flush_file_log_if_due();
+
+        lock.lock();
+        if (!drained)
+        {
+            continue;
+        }
+
+        // the records logged before the flush request are written
+        state.flush_done = flush_target;
+        state.flushed.notify_all();
+        state.buffers.erase(
+            std::remove_if(state.buffers.begin(), state.buffers.end(),
+                [](const std::shared_ptr<detail::log_buffer> &buffer)
+                {
+                    return buffer->retired.load(std::memory_order_acquire) && buffer->empty();
+                }),
+            state.buffers.end());
+
+        if (stopping)
+        {
+            break;
+        }
+
+        // park until a record, a flush or the file batch is due. a writer does not fence
+        // after publishing its record and may miss the flag, max_park_time bounds that delay
+        detail::g_log_thread_parked.store(true, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool pending = std::any_of(state.buffers.begin(), state.buffers.end(),
+            [](const std::shared_ptr<detail::log_buffer> &buffer)
+            {
+                return buffer->front() != nullptr;
+            });
+        if (!pending)
+        {
+            state.wake.wait_for(lock, file_log_wait_time(), [&](){
+                return !detail::g_log_thread_parked.load(std::memory_order_relaxed) ||
+                       state.stop || state.flush_requested != flush_target;
+            });
+        }
+        detail::g_log_thread_parked.store(false, std::memory_order_relaxed);
+    }
+}
+
+void detail::wake_log_thread()
+{
+    // only the writer clearing the flag notifies
+    if (g_log_thread_parked.exchange(false, std::memory_order_acq_rel))
+    {
+        log_backend &state = backend();
+        {
+            // the log thread checks the flag under the mutex before it waits
+            std::lock_guard<std::mutex> lock(state.mutex);
+        }
+        state.wake.notify_one();
+    }
+}
+
+static thread_local bool t_thread_exited = false;
+
+/**
+ * retires the buffer of a thread when the thread exits
+ */
+struct thread_buffer_holder
+{
+    ~thread_buffer_holder()
+    {
+        detail::t_log_buffer = nullptr;
+        t_thread_exited = true;
+        if (buffer)
+        {
+            buffer->retired.store(true, std::memory_order_release);
+        }
+    }
+
+    std::shared_ptr<detail::log_buffer> buffer;
+};
+
+static thread_local thread_buffer_holder t_buffer_holder;
+
+detail::log_buffer* detail::register_thread()
+{
+    if (t_thread_exited)
+    {
+        return nullptr;
+    }
+
+    log_backend &state = backend();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.stop)
+    {
+        return nullptr;
+    }
+
+    auto buffer = std::make_shared<log_buffer>(thread_buffer_size,
+                      logging::aux::this_thread::get_id().native_id());
+    state.buffers.push_back(buffer);
+    t_buffer_holder.buffer = buffer;
+    t_log_buffer = buffer.get();
+
+    if (!state.thread.joinable())
+    {
+        state.thread = std::thread([&state](){ run_backend(state); });
+    }
+    return buffer.get();
+}
+
+void detail::write_direct(const record_header &header)
+{
+    std::string message;
+    format_record(header, message);
+    LOGGER(static_cast<severity_level>(header.level))
+        << base_name(header.file) << ":" << header.line << " " << message;
+}
+
+void flush_log()
+{
+    log_backend &state = backend();
+    std::unique_lock<std::mutex> lock(state.mutex);
+    if (!state.thread.joinable() || state.stop)
+    {
+        return;
+    }
+    uint64_t target = ++state.flush_requested;
+    state.wake.notify_one();
+    state.flushed.wait(lock, [&](){ return state.flush_done >= target; });
+    lock.unlock();
+    logging::core::get()->flush();
+}
+
+void stop_log()
+{
+    log_backend &state = backend();
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (state.stop)
+        {
+            return;
+        }
+        state.stop = true;
+    }
+    state.wake.notify_one();
+    if (state.thread.joinable())
+    {
+        state.thread.join();
+    }
+    detail::t_log_buffer = nullptr;
+    logging::core::get()->flush();
 }
 
 } //namespace logger
@@ -2,8 +2,19 @@
 #define _LOG_H_
 
 #include <string>
+#include <atomic>
 #include <boost/log/common.hpp>
 
+#include "binary_log.h"
+
+/**
+ * records below it are compiled out, 0 trace ... 5 fatal.
+ * release builds set it to 2 so trace and debug cost nothing
+ */
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
 namespace logger {
 
 /**
@@ -34,6 +45,22 @@ void init_log(const std::string& log_file_name,
  */
 void set_log_level(severity_level level);
 
+/**
+ * current log level, read by the LOG_* macros before anything is formatted
+ */
+extern std::atomic<int> g_log_level;
+
+inline bool should_log(severity_level level)
+{
+    return level >= g_log_level.load(std::memory_order_relaxed);
+}
+
+/**
+ * the file log collects records and writes them when flush_bytes are collected,
+ * after flush_interval (unit:ms) or at an error record. flush_bytes 0 writes every record
+ */
+void set_file_log_flush(size_t flush_bytes, size_t flush_interval);
+
 /**
  * open console level
  */
@@ -45,9 +72,27 @@ void open_console_log();
 void close_console_log();
 
 /**
- * write log, client should not use this function
+ * wait until the log thread has written the records logged before this call
+ */
+void flush_log();
+
+/**
+ * write the remaining records and stop the log thread, call it after the other
+ * threads have stopped. later records are written directly
  */
-void write_log(severity_level level, const char *file, int line, const char *format, ...);
+void stop_log();
+
+/**
+ * write log, client should not use this function.
+ * the arguments are copied in binary into a buffer of the calling thread,
+ * the log thread formats and writes them. only the address of format is kept,
+ * so it must be a string literal
+ */
+template<std::size_t N, typename... Args>
+inline void write_log(severity_level level, const char *file, int line, const char (&format)[N], const Args&... args)
+{
+    detail::write_record(level, file, line, format, detail::to_arg(args)...);
+}
 
 } //namespace logger 
 
@@ -64,13 +109,22 @@ using logger::fatal;
 #define LOGGER(level) BOOST_LOG_SEV(logger::my_logger::get(), level)
 
 /**
- * c style log
+ * c style log, arguments are only evaluated if the level is enabled.
+ * format must be a string literal, %s takes no precision
  */
-#define LOG_TRACE(format, ...) logger::write_log(trace, __FILE__, __LINE__, format, ##__VA_ARGS__)
-#define LOG_DEBUG(format, ...) logger::write_log(debug, __FILE__, __LINE__, format, ##__VA_ARGS__)
-#define LOG_INFO(format, ...) logger::write_log(info, __FILE__, __LINE__, format, ##__VA_ARGS__)
-#define LOG_WARN(format, ...) logger::write_log(warn, __FILE__, __LINE__, format, ##__VA_ARGS__)
-#define LOG_ERROR(format, ...) logger::write_log(error, __FILE__, __LINE__, format, ##__VA_ARGS__)
-#define LOG_FATAL(format, ...) logger::write_log(fatal, __FILE__, __LINE__, format, ##__VA_ARGS__)
+#define LOG_WRITE(level, format, ...) \
+    do { \
+        static_assert(logger::detail::check_format(format), \
+                      "no precision with %s, pass a std::string_view"); \
+        if (LOG_MIN_LEVEL <= (level) && logger::should_log(level)) \
+            logger::write_log(level, __FILE__, __LINE__, format, ##__VA_ARGS__); \
+    } while (0)
+
+#define LOG_TRACE(format, ...) LOG_WRITE(logger::trace, format, ##__VA_ARGS__)
+#define LOG_DEBUG(format, ...) LOG_WRITE(logger::debug, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...) LOG_WRITE(logger::info, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...) LOG_WRITE(logger::warn, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) LOG_WRITE(logger::error, format, ##__VA_ARGS__)
+#define LOG_FATAL(format, ...) LOG_WRITE(logger::fatal, format, ##__VA_ARGS__)
 
 #endif //_LOG_H_
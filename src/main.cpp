@@ -108,11 +108,14 @@ int main(int argc, char* argv[])
 
     logger::init_log(config::Config::instance().getLogFile(),
                      getOption.getLogLevel());
+    logger::set_file_log_flush(config::Config::instance().getLogFlushBytes(),
+                               config::Config::instance().getLogFlushInterval());
     LOG_INFO("init log success");
 
     if (!createPidFile(config::Config::instance().getPidFile()))
     {
         LOG_ERROR("create pid file %s failed\n", config::Config::instance().getPidFile().c_str());
+        logger::stop_log();
         return -1;
     }
 
@@ -141,6 +144,7 @@ int main(int argc, char* argv[])
     // program exit cleanup
 
     remove(config::Config::instance().getPidFile().c_str());
+    logger::stop_log();
 
     return 0;
 }
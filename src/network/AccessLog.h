@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <cstddef>
+
+#include "log/log.h"
+
+namespace network {
+
+/**
+ * access log of one io_context, one compact line for a request:
+ * peer "request" status bytes latency. one of every sample requests is logged,
+ * at most rate_limit lines a second, bodies are never logged.
+ * only use it from the thread of its io_context
+ */
+class AccessLog
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @param sample log one of this many requests, 0 for none
+     * @param rate_limit max lines a second, 0 for no limit
+     */
+    AccessLog(std::size_t sample, std::size_t rate_limit)
+      : sample_(sample),
+        rate_limit_(rate_limit)
+    {}
+
+    AccessLog(const AccessLog&) = delete;
+    AccessLog& operator=(const AccessLog&) = delete;
+
+    /**
+     * called for each request, true if it is logged
+     */
+    bool Sample()
+    {
+        if (sample_ == 0 || LOG_MIN_LEVEL > logger::info || !logger::should_log(logger::info))
+        {
+            return false;
+        }
+        if (++request_count_ < sample_)
+        {
+            return false;
+        }
+        request_count_ = 0;
+
+        if (rate_limit_ != 0)
+        {
+            Clock::time_point now = Clock::now();
+            if (now - window_start_ >= std::chrono::seconds(1))
+            {
+                if (suppressed_count_ > 0)
+                {
+                    LOG_WARN("access log rate limit, %lu lines suppressed", suppressed_count_);
+                }
+                window_start_ = now;
+                line_count_ = 0;
+                suppressed_count_ = 0;
+            }
+            if (line_count_ >= rate_limit_)
+            {
+                suppressed_count_++;
+                return false;
+            }
+            line_count_++;
+        }
+        return true;
+    }
+
+    void Write(const std::string &peer, const std::string &request, int status,
+               std::size_t bytes, Clock::duration latency)
+    {
+        LOG_INFO("access %s \"%s\" %d %lu %ldus", peer, request, status, bytes,
+            std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+    }
+
+private:
+    std::size_t sample_;
+    std::size_t rate_limit_;
+    std::size_t request_count_ = 0;
+    Clock::time_point window_start_;
+    std::size_t line_count_ = 0; // lines in the current second
+    std::size_t suppressed_count_ = 0;
+};
+
+} // namespace network
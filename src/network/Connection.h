@@ -2,13 +2,19 @@
 
 #include <memory>
 #include <vector>
-#include <list>
+#include <deque>
 #include <sstream>
+#include <functional>
+#include <cstdint>
 
 #include <boost/asio.hpp>
 
 #include "log/log.h"
 #include "ConnectionManager.h"
+#include "ConnectionPool.h"
+#include "InputBuffer.h"
+#include "TimingWheel.h"
+#include "AccessLog.h"
 
 namespace network {
 
@@ -20,6 +26,10 @@ public:
     using ResponseType = typename Protocol::ResponseType;
     using HandlerType = typename Protocol::HandlerType;
     using ParseResultType = typename Protocol::ParseResult;
+    using KeepAliveType = typename Protocol::KeepAlive;
+    using BodyStateType = typename Protocol::BodyState;
+    using ResumerType = typename Protocol::Resumer;
+    using ResumerFactoryType = typename Protocol::ResumerFactory;
 
     using Ptr = std::shared_ptr<Connection>;
 
@@ -27,18 +37,37 @@ public:
     Connection& operator=(const Connection&) = delete;
 
     Connection(boost::asio::ip::tcp::socket socket,
-               ConnectionManager<Connection> &connection_manager)
+               ConnectionManager<Connection> &connection_manager,
+               std::shared_ptr<ConnectionPool> connection_pool)
       : socket_(std::move(socket)),
-        connection_manager_(connection_manager)
-    {}
+        connection_manager_(connection_manager),
+        connection_pool_(std::move(connection_pool)),
+        input_buffer_(connection_pool_->AcquireBuffer(),
+                      connection_manager.GetSettings().read_buffer_high_water)
+    {
+        const ConnectionSettings &settings = connection_manager.GetSettings();
+        protocol_.SetLimits(settings.max_body_size, settings.read_buffer_high_water);
+        handler_.set_worker_pool(connection_manager.GetWorkerPool());
+        timer_.callback = [this]() { OnTimeout(); };
+        make_parse_resumer_ = [this]() { return MakeParseResumer(); };
+    }
+
+    ~Connection()
+    {
+        connection_pool_->ReleaseBuffer(input_buffer_.Release());
+    }
 
     void Start()
     {
         DoRead();
+        UpdateTimer();
     }
 
     void Stop()
     {
+        // a stopped connection never arms the timer again,
+        // so it is not touched when the connection is released on another thread
+        connection_manager_.GetTimingWheel().Cancel(timer_);
         socket_.close();
     }
 
@@ -54,75 +83,82 @@ public:
 
     std::string GetPeerAddress() const
     {
+        // the socket may be closed already, don't throw
+        boost::system::error_code ec;
+        boost::asio::ip::tcp::endpoint endpoint = socket_.remote_endpoint(ec);
+        if (ec)
+        {
+            return "unknown";
+        }
+
         std::ostringstream ss;
-        ss << socket_.remote_endpoint();
+        ss << endpoint;
         return ss.str();
     }
 
 private:
+    enum class TimeoutKind
+    {
+        NONE,
+        HEADER, // request line and headers
+        BODY,   // request body
+        IDLE,   // keep-alive, no request in progress
+        WRITE,
+        LINGER  // draining input after the final response
+    };
+
+    struct Item
+    {
+        ResponseType response;
+        std::uint64_t sequence = 0; // request order on this connection
+        bool ready = true; // false while an async handler is running
+        bool head_sent = false; // a streamed response stays queued after its head is sent
+        bool body_pending = false; // the streamed body waits for its producer to resume it
+        ResumerType resume; // of a streamed body
+        KeepAliveType keep_alive = KeepAliveType::DEFAULT;
+        int version = 0; // of the request, as the protocol numbers it
+        std::size_t bytes_sent = 0;
+        bool log_access = false; // sampled for the access log
+        std::string access_request; // what the access log shows of the request
+        AccessLog::Clock::time_point start;
+    };
+
     void DoRead()
     {
-        auto buffer_view = boost::asio::dynamic_buffer(buff_);
-        constexpr std::size_t max_buff_size = 8192;
+        boost::asio::mutable_buffer buffer = input_buffer_.Prepare();
+        if (buffer.size() == 0)
+        {
+            LOG_ERROR("%s request exceeds input buffer, close connection", GetPeerAddress().c_str());
+            connection_manager_.Stop(this->shared_from_this());
+            return;
+        }
 
         auto self(this->shared_from_this());
-        socket_.async_read_some(buffer_view.prepare(max_buff_size),
+        socket_.async_read_some(buffer,
             [this, self](boost::system::error_code ec, std::size_t bytes_transferred)
             {
                 LOG_TRACE("%s receive %lu bytes", GetPeerAddress().c_str(), bytes_transferred);
+                input_buffer_.Commit(bytes_transferred);
                 if (!ec)
                 {
-                    // process all received request
-                    while (buff_.size() > 0)
+                    if (ProcessInput())
                     {
-                        ParseResultType parse_result = ParseResultType::BAD;
-                        std::size_t used_bytes = 0;
-                        std::tie(parse_result, used_bytes) =
-                            protocol_.Parse(request_, buff_.data(), buff_.size());
-                        auto buffer_view = boost::asio::dynamic_buffer(buff_);
-                        buffer_view.consume(used_bytes);
-                        
-                        if (parse_result == ParseResultType::BAD)
-                        {
-                            LOG_ERROR("protocol parse error, close connection");
-                            connection_manager_.Stop(this->shared_from_this());
-                            return;
-                        }
-                        else if (parse_result == ParseResultType::GOOD)
-                        {
-                            LOG_INFO("receive request %s", request_.to_string().c_str());
-                            ResponseType response;
-                            handler_.handle(request_, response);
-                            Item item;
-                            protocol_.Serialize(response, *item.streambuf);
-                            item.response = std::move(response);
-
-                            // print serialize result
-                            auto buf = item.streambuf->data();
-                            const char* ptr = boost::asio::buffer_cast<const char*>(buf);
-                            std::string str(ptr, buf.size());
-                            LOG_TRACE("serialize to %s", str.c_str());
-
-                            bool write_in_progress = !output_queue_.empty();
-                            output_queue_.push_back(std::move(item));
-                            if (!write_in_progress)
-                            {
-                                DoWrite();
-                            }
-                        }
-                        else if (parse_result == ParseResultType::NEED_MORE)
-                        {
-                            break;
-                        }
+                        DoRead();
                     }
-
-                    DoRead();
+                    UpdateTimer();
                 }
                 else if (ec != boost::asio::error::operation_aborted)
                 {
                     if (ec == boost::asio::error::eof)
                     {
                         LOG_INFO("peer %s close connection", GetPeerAddress().c_str());
+                        if (!output_queue_.empty())
+                        {
+                            // the peer only closed its sending side, finish the responses
+                            closing_ = true;
+                            UpdateTimer();
+                            return;
+                        }
                     }
                     else
                     {
@@ -134,21 +170,436 @@ private:
             });
     }
 
+    /**
+     * parse and handle all received requests, return false if the connection stops reading
+     */
+    bool ProcessInput()
+    {
+        // the final response may be known only when it is serialized
+        if (closing_)
+        {
+            return false;
+        }
+
+        // a streamed body may end with the chunk the handler just finished, without more input
+        while (input_buffer_.Size() > 0 || protocol_.IsReadingBody())
+        {
+            ParseResultType parse_result = ParseResultType::BAD;
+            std::size_t used_bytes = 0;
+            std::tie(parse_result, used_bytes) = protocol_.Parse(
+                request_, handler_, make_parse_resumer_, input_buffer_.Data(), input_buffer_.Size());
+
+            if (parse_result == ParseResultType::GOOD)
+            {
+                request_count_++;
+                // the header timeout of the next request starts now
+                timeout_kind_ = TimeoutKind::NONE;
+                Item &item = output_queue_.emplace_back();
+                item.sequence = next_sequence_++;
+                if (connection_manager_.GetAccessLog().Sample())
+                {
+                    item.log_access = true;
+                    item.start = AccessLog::Clock::now();
+                    protocol_.DescribeRequest(request_, item.access_request);
+                }
+                item.keep_alive = protocol_.GetKeepAlive(request_);
+                item.version = protocol_.GetVersion(request_);
+                std::size_t max_requests = connection_manager_.GetSettings().max_requests_per_connection;
+                if (max_requests != 0 && request_count_ >= max_requests)
+                {
+                    item.keep_alive = KeepAliveType::CLOSE;
+                }
+                if (item.keep_alive == KeepAliveType::CLOSE)
+                {
+                    // the last request, pipelined input after it is ignored
+                    closing_ = true;
+                }
+
+                if (handler_.is_cpu_bound(request_) && Offload(item, used_bytes))
+                {
+                    // request_ and input_buffer_ are used by the worker until it finishes
+                    return false;
+                }
+                else if (handler_.is_async(request_))
+                {
+                    item.ready = false;
+                    handler_.handle_async(request_, MakeResponder(item.sequence));
+                }
+                else
+                {
+                    handler_.handle(request_, item.response);
+                }
+                StartWrite();
+
+                // request points into input_buffer_, release it after handled
+                input_buffer_.Consume(used_bytes);
+
+                if (closing_)
+                {
+                    return false;
+                }
+
+                // stop parsing until the slow responses are written
+                if (output_queue_.size() >= connection_manager_.GetSettings().max_pending_responses)
+                {
+                    read_paused_ = true;
+                    return false;
+                }
+            }
+            else if (parse_result == ParseResultType::NEED_MORE)
+            {
+                // bytes of streamed body chunks are handled already
+                input_buffer_.Consume(used_bytes);
+                break;
+            }
+            else if (parse_result == ParseResultType::PAUSED)
+            {
+                // the handler reads the chunk in input_buffer_ until it resumes parsing
+                parse_paused_ = true;
+                paused_bytes_ = used_bytes;
+                read_paused_ = true;
+                return false;
+            }
+            else
+            {
+                LOG_ERROR("%s protocol parse error, close connection", GetPeerAddress().c_str());
+                Item &item = output_queue_.emplace_back();
+                item.sequence = next_sequence_++;
+                item.keep_alive = KeepAliveType::CLOSE;
+                if (connection_manager_.GetAccessLog().Sample())
+                {
+                    item.log_access = true;
+                    item.start = AccessLog::Clock::now();
+                    item.access_request = "-";
+                }
+                protocol_.MakeErrorResponse(parse_result, item.response);
+                closing_ = true;
+                StartWrite();
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * the responder completes the item on the connection's thread, it keeps the connection alive
+     */
+    std::function<void(ResponseType)> MakeResponder(std::uint64_t sequence)
+    {
+        auto self(this->shared_from_this());
+        return [self, sequence](ResponseType response)
+        {
+            boost::asio::post(self->GetExecutor(),
+                [self, sequence, response = std::move(response)]() mutable
+                {
+                    self->Complete(sequence, std::move(response));
+                });
+        };
+    }
+
+    /**
+     * the resumer continues a pending streamed body on the connection's thread.
+     * it is kept by the body producer, so it doesn't keep the connection alive
+     */
+    ResumerType MakeResumer(std::uint64_t sequence)
+    {
+        std::weak_ptr<Connection> weak(this->shared_from_this());
+        return [weak, sequence]()
+        {
+            if (Ptr self = weak.lock())
+            {
+                boost::asio::post(self->GetExecutor(),
+                    [self, sequence]()
+                    {
+                        self->Resume(sequence);
+                    });
+            }
+        };
+    }
+
+    /**
+     * the resumer continues parsing after the handler processed a streamed body chunk.
+     * it keeps the connection alive, the chunk is in its input buffer
+     */
+    ResumerType MakeParseResumer()
+    {
+        auto self(this->shared_from_this());
+        return [self]()
+        {
+            boost::asio::post(self->GetExecutor(),
+                [self]()
+                {
+                    self->ResumeParse();
+                });
+        };
+    }
+
+    void ResumeParse()
+    {
+        parse_paused_ = false;
+        input_buffer_.Consume(paused_bytes_);
+        paused_bytes_ = 0;
+        if (!socket_.is_open())
+        {
+            return;
+        }
+        if (draining_)
+        {
+            DoDrain();
+            return;
+        }
+        ResumeRead();
+        UpdateTimer();
+    }
+
+    /**
+     * handle request_ on the worker pool, parsing is paused until the worker finishes.
+     * return false if there is no worker pool or its queue is full
+     */
+    bool Offload(Item &item, std::size_t used_bytes)
+    {
+        util::WorkerPool *worker_pool = connection_manager_.GetWorkerPool();
+        if (worker_pool == nullptr)
+        {
+            return false;
+        }
+
+        auto self(this->shared_from_this());
+        std::uint64_t sequence = item.sequence;
+        bool posted = worker_pool->Post([self, sequence, used_bytes]()
+            {
+                ResponseType response;
+                self->handler_.handle(self->request_, response);
+                boost::asio::post(self->GetExecutor(),
+                    [self, sequence, used_bytes, response = std::move(response)]() mutable
+                    {
+                        self->offloading_ = false;
+                        self->input_buffer_.Consume(used_bytes);
+                        // the connection stopped while the worker ran
+                        if (!self->socket_.is_open())
+                        {
+                            return;
+                        }
+                        if (self->draining_)
+                        {
+                            self->DoDrain();
+                            return;
+                        }
+                        self->Complete(sequence, std::move(response));
+                        self->ResumeRead();
+                        self->UpdateTimer();
+                    });
+            });
+        if (!posted)
+        {
+            LOG_WARN("worker queue is full, handle request on io thread");
+            return false;
+        }
+
+        item.ready = false;
+        offloading_ = true;
+        read_paused_ = true;
+        return true;
+    }
+
+    void Complete(std::uint64_t sequence, ResponseType response)
+    {
+        if (!socket_.is_open())
+        {
+            return;
+        }
+
+        // items are queued in sequence order and only removed from the front,
+        // items after the final response are dropped
+        if (output_queue_.empty() || sequence < output_queue_.front().sequence)
+        {
+            return;
+        }
+        Item &item = output_queue_[sequence - output_queue_.front().sequence];
+        item.response = std::move(response);
+        item.ready = true;
+        StartWrite();
+        UpdateTimer();
+    }
+
+    void Resume(std::uint64_t sequence)
+    {
+        if (!socket_.is_open() || output_queue_.empty() || sequence < output_queue_.front().sequence)
+        {
+            return;
+        }
+        output_queue_[sequence - output_queue_.front().sequence].body_pending = false;
+        StartWrite();
+        UpdateTimer();
+    }
+
+    void StartWrite()
+    {
+        if (!writing_ && !output_queue_.empty() && output_queue_.front().ready &&
+            !output_queue_.front().body_pending)
+        {
+            DoWrite();
+        }
+    }
+
+    void ResumeRead()
+    {
+        if (socket_.is_open() && read_paused_ && !closing_ && !offloading_ && !parse_paused_ &&
+            output_queue_.size() < connection_manager_.GetSettings().max_pending_responses)
+        {
+            read_paused_ = false;
+            if (ProcessInput())
+            {
+                DoRead();
+            }
+        }
+    }
+
     void DoWrite()
     {
+        writing_ = true;
         auto self(this->shared_from_this());
-        const Item& item = output_queue_.front();
-        boost::asio::async_write(socket_, *item.streambuf,
-            [this, self](boost::system::error_code ec, std::size_t bytes_transferred)
+        const ConnectionSettings &settings = connection_manager_.GetSettings();
+
+        // serialize the heads of queued responses into head_buffer_, up to the batch limits.
+        // heads are contiguous, only non-empty bodies split them into separate buffers
+        head_buffer_.clear();
+        write_segments_.clear();
+        std::size_t body_bytes = 0;
+        std::size_t complete_count = 0;
+        for (Item &item : output_queue_)
+        {
+            // responses are sent in order, stop at the first one still being handled
+            if (!item.ready)
+            {
+                break;
+            }
+            if (!write_segments_.empty() &&
+                (head_buffer_.size() + body_bytes >= settings.write_batch_bytes ||
+                 2 * (write_segments_.size() + 1) > settings.write_batch_buffers))
+            {
+                break;
+            }
+
+            std::size_t head_size = head_buffer_.size();
+            boost::asio::const_buffer body;
+            if (!item.head_sent)
+            {
+                body = protocol_.Serialize(item.response, item.keep_alive, item.version, head_buffer_);
+                item.head_sent = true;
+                if (item.keep_alive == KeepAliveType::CLOSE)
+                {
+                    closing_ = true;
+                }
+            }
+
+            // a streamed body is produced until the batch is full or the producer has
+            // nothing ready, the rest is produced after this batch is written or on resume
+            bool complete = true;
+            if (protocol_.IsStreamed(item.response))
+            {
+                if (!item.resume)
+                {
+                    item.resume = MakeResumer(item.sequence);
+                }
+
+                BodyStateType state = BodyStateType::MORE;
+                do
+                {
+                    std::size_t produced = head_buffer_.size();
+                    state = protocol_.SerializeChunk(item.response, item.version, item.resume, head_buffer_);
+                    if (state == BodyStateType::MORE && head_buffer_.size() == produced)
+                    {
+                        // calling it again at once would poll, it has the resumer to say when it has data
+                        LOG_ERROR("%s body producer returned MORE without data, wait for its resumer",
+                            GetPeerAddress().c_str());
+                        state = BodyStateType::PENDING;
+                    }
+                } while (state == BodyStateType::MORE &&
+                         head_buffer_.size() + body_bytes < settings.write_batch_bytes);
+
+                item.body_pending = (state == BodyStateType::PENDING);
+                complete = (state == BodyStateType::DONE);
+            }
+
+            item.bytes_sent += head_buffer_.size() - head_size + body.size();
+            write_segments_.push_back(WriteSegment{head_buffer_.size(), body});
+            body_bytes += body.size();
+            if (!complete)
+            {
+                break;
+            }
+            complete_count++;
+            if (item.keep_alive == KeepAliveType::CLOSE)
+            {
+                // the final response
+                break;
+            }
+        }
+        LOG_TRACE("serialize to %s", head_buffer_.c_str());
+        if (head_buffer_.empty() && body_bytes == 0)
+        {
+            // only a pending body without data, its resumer starts the next write
+            writing_ = false;
+            UpdateTimer();
+            return;
+        }
+
+        // build buffers after all heads are written, head_buffer_ may reallocate
+        write_buffers_.clear();
+        std::size_t head_begin = 0;
+        for (const WriteSegment &segment : write_segments_)
+        {
+            if (segment.body.size() == 0)
+            {
+                continue;
+            }
+            write_buffers_.push_back(boost::asio::buffer(head_buffer_.data() + head_begin,
+                                                         segment.head_end - head_begin));
+            write_buffers_.push_back(segment.body);
+            head_begin = segment.head_end;
+        }
+        if (head_begin < head_buffer_.size())
+        {
+            write_buffers_.push_back(boost::asio::buffer(head_buffer_.data() + head_begin,
+                                                         head_buffer_.size() - head_begin));
+        }
+
+        boost::asio::async_write(socket_, write_buffers_,
+            [this, self, complete_count](boost::system::error_code ec, std::size_t bytes_transferred)
             {
                 if (!ec)
                 {
-                    LOG_INFO("send response %s", output_queue_.front().response.to_string().c_str());
-                    output_queue_.pop_front();
+                    bool final_sent = false;
+                    for (std::size_t i = 0; i < complete_count; i++)
+                    {
+                        if (output_queue_.front().log_access)
+                        {
+                            WriteAccessLog(output_queue_.front());
+                        }
+                        final_sent = (output_queue_.front().keep_alive == KeepAliveType::CLOSE);
+                        output_queue_.pop_front();
+                    }
+                    writing_ = false;
+                    if (final_sent)
+                    {
+                        // requests pipelined after the final response are not answered
+                        output_queue_.clear();
+                        Shutdown();
+                        return;
+                    }
                     if (!output_queue_.empty())
                     {
-                        DoWrite();
+                        StartWrite();
                     }
+                    else if (closing_)
+                    {
+                        Shutdown();
+                        return;
+                    }
+                    ResumeRead();
+                    UpdateTimer();
                 }
                 else
                 {
@@ -159,19 +610,171 @@ private:
             });
     }
 
-    struct Item
+    void WriteAccessLog(const Item &item)
     {
-        ResponseType response;
-        std::shared_ptr<boost::asio::streambuf> streambuf = std::make_shared<boost::asio::streambuf>();
+        connection_manager_.GetAccessLog().Write(GetPeerAddress(), item.access_request,
+            protocol_.GetStatus(item.response), item.bytes_sent, AccessLog::Clock::now() - item.start);
+    }
+
+    /**
+     * half-close after the final response: the peer reads it up to EOF and closes its side.
+     * input is drained meanwhile, closing with unread input would reset the connection
+     * and could destroy the response before the peer reads it
+     */
+    void Shutdown()
+    {
+        boost::system::error_code ec;
+        socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
+        if (ec)
+        {
+            connection_manager_.Stop(this->shared_from_this());
+            return;
+        }
+
+        draining_ = true;
+        UpdateTimer();
+        // a worker or body handler still reads the input buffer, drain after it finishes
+        if (!offloading_ && !parse_paused_)
+        {
+            DoDrain();
+        }
+    }
+
+    void DoDrain()
+    {
+        input_buffer_.Consume(input_buffer_.Size());
+        auto self(this->shared_from_this());
+        socket_.async_read_some(input_buffer_.Prepare(),
+            [this, self](boost::system::error_code ec, std::size_t bytes_transferred)
+            {
+                if (!ec)
+                {
+                    input_buffer_.Commit(bytes_transferred);
+                    DoDrain();
+                }
+                else if (ec != boost::asio::error::operation_aborted)
+                {
+                    connection_manager_.Stop(this->shared_from_this());
+                }
+            });
+    }
+
+    /**
+     * arm the timeout of what the connection is waiting for. the header timeout covers
+     * the whole header block, so a client sending it byte by byte can't extend it.
+     * the others are inactivity timeouts and restart on every call
+     */
+    void UpdateTimer()
+    {
+        if (!socket_.is_open())
+        {
+            return;
+        }
+
+        TimeoutKind kind = TimeoutKind::NONE;
+        if (draining_)
+        {
+            kind = TimeoutKind::LINGER;
+        }
+        else if (writing_)
+        {
+            kind = TimeoutKind::WRITE;
+        }
+        else if (!output_queue_.empty() || parse_paused_)
+        {
+            // waiting for handlers, not for the client
+            kind = TimeoutKind::NONE;
+        }
+        else if (protocol_.IsReadingBody())
+        {
+            kind = TimeoutKind::BODY;
+        }
+        else if (input_buffer_.Size() > 0 || request_count_ == 0)
+        {
+            kind = TimeoutKind::HEADER;
+        }
+        else
+        {
+            kind = TimeoutKind::IDLE;
+        }
+
+        TimingWheel &timing_wheel = connection_manager_.GetTimingWheel();
+        if (kind == TimeoutKind::HEADER && timeout_kind_ == TimeoutKind::HEADER && timer_.Armed())
+        {
+            return;
+        }
+        timeout_kind_ = kind;
+
+        TimingWheel::Clock::duration timeout = GetTimeout(kind);
+        if (timeout == TimingWheel::Clock::duration::zero())
+        {
+            timing_wheel.Cancel(timer_);
+            return;
+        }
+        timing_wheel.Arm(timer_, timeout);
+    }
+
+    TimingWheel::Clock::duration GetTimeout(TimeoutKind kind) const
+    {
+        const ConnectionSettings &settings = connection_manager_.GetSettings();
+        switch (kind)
+        {
+        case TimeoutKind::HEADER:
+            return settings.header_timeout;
+        case TimeoutKind::BODY:
+            return settings.body_timeout;
+        case TimeoutKind::IDLE:
+            return settings.idle_timeout;
+        case TimeoutKind::WRITE:
+            return settings.write_timeout;
+        case TimeoutKind::LINGER:
+            return settings.linger_timeout;
+        default:
+            return TimingWheel::Clock::duration::zero();
+        }
+    }
+
+    void OnTimeout()
+    {
+        static const char *names[] = {"none", "header", "body", "idle", "write", "linger"};
+        LOG_INFO("%s %s timeout, close connection",
+            GetPeerAddress().c_str(), names[static_cast<int>(timeout_kind_)]);
+        connection_manager_.Stop(this->shared_from_this());
+    }
+
+    friend class ConnectionManager<Connection>;
+
+    // a response in the write batch
+    struct WriteSegment
+    {
+        std::size_t head_end; // end of its head in head_buffer_
+        boost::asio::const_buffer body;
     };
 
     boost::asio::ip::tcp::socket socket_;
     ConnectionManager<Connection>& connection_manager_;
-    std::vector<char> buff_; // input data buffer
+    std::size_t manager_slot_ = ConnectionManager<Connection>::npos; // position in connection_manager_
+    std::shared_ptr<ConnectionPool> connection_pool_;
+    InputBuffer input_buffer_; // storage is taken from connection_pool_
     Protocol protocol_;
     RequestType request_;
     HandlerType handler_;
-    std::list<Item> output_queue_;
+    std::deque<Item> output_queue_;
+    bool writing_ = false; // a write of output_queue_ is in progress
+    bool closing_ = false; // close after output_queue_ is written
+    bool draining_ = false; // the final response is written, waiting for the peer to close
+    bool read_paused_ = false; // too many responses are pending, input is not parsed
+    bool offloading_ = false; // a worker is handling request_
+    bool parse_paused_ = false; // the handler is processing a streamed body chunk
+    std::size_t paused_bytes_ = 0; // input consumed once the handler resumes parsing
+    ResumerFactoryType make_parse_resumer_;
+    std::uint64_t next_sequence_ = 0;
+    std::size_t request_count_ = 0;
+    TimingWheel::Node timer_; // in the timing wheel of connection_manager_
+    TimeoutKind timeout_kind_ = TimeoutKind::NONE;
+    std::string head_buffer_; // serialized heads of the responses in writing
+    std::vector<WriteSegment> write_segments_;
+    std::vector<boost::asio::const_buffer> write_buffers_;
 };
 
 } // namespace network
@@ -1,15 +1,45 @@
 #pragma once
 
-#include <set>
+#include <vector>
 #include <memory>
+#include <limits>
+#include <atomic>
+
+#include <boost/asio.hpp>
+
+#include "ConnectionSettings.h"
+#include "TimingWheel.h"
+#include "AccessLog.h"
+#include "utils/WorkerPool.h"
 
 namespace network {
 
+/**
+ * connections of one io_context. each io_context has its own manager and only
+ * touches it from its own thread, so no lock is needed.
+ * connections are kept in a vector and remember their slot, add and remove are O(1)
+ */
 template<typename Connection>
 class ConnectionManager
 {
 public:
-    ConnectionManager()
+    static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+    /**
+     * @param io_context the io_context the connections run on
+     * @param connection_count connections of the io_context, the acceptor increases it
+     *        when it places a connection, the manager decreases it when the connection stops
+     * @param settings settings of the connections, must outlive the manager
+     * @param worker_pool runs cpu bound requests, nullptr to run them on the io thread
+     */
+    ConnectionManager(boost::asio::io_context &io_context,
+                      std::atomic<std::size_t> &connection_count, const ConnectionSettings &settings,
+                      util::WorkerPool *worker_pool = nullptr)
+      : connection_count_(connection_count),
+        settings_(settings),
+        worker_pool_(worker_pool),
+        timing_wheel_(io_context),
+        access_log_(settings.access_log_sample, settings.access_log_rate_limit)
     {}
     ~ConnectionManager()
     {
@@ -20,28 +50,80 @@ public:
 
     void Start(const std::shared_ptr<Connection> &connection)
     {
-        connections_.insert(connection);
+        connection->manager_slot_ = connections_.size();
+        connections_.push_back(connection);
         connection->Start();
     }
 
     void Stop(const std::shared_ptr<Connection> &connection)
     {
-        connections_.erase(connection);
+        std::size_t slot = connection->manager_slot_;
+        if (slot != npos)
+        {
+            // move the last connection into the freed slot
+            if (slot != connections_.size() - 1)
+            {
+                connections_[slot] = std::move(connections_.back());
+                connections_[slot]->manager_slot_ = slot;
+            }
+            connections_.pop_back();
+            connection->manager_slot_ = npos;
+            connection_count_.fetch_sub(1, std::memory_order_relaxed);
+        }
+
         connection->Stop();
     }
 
+    /**
+     * stop all connections, only call it when the io_context is not running
+     */
     void StopAll()
     {
         for (auto &connection : connections_)
         {
+            connection->manager_slot_ = npos;
             connection->Stop();
         }
 
+        connection_count_.fetch_sub(connections_.size(), std::memory_order_relaxed);
         connections_.clear();
     }
 
+    std::size_t Size() const
+    {
+        return connections_.size();
+    }
+
+    const ConnectionSettings& GetSettings() const
+    {
+        return settings_;
+    }
+
+    util::WorkerPool* GetWorkerPool() const
+    {
+        return worker_pool_;
+    }
+
+    /**
+     * timeouts of the connections
+     */
+    TimingWheel& GetTimingWheel()
+    {
+        return timing_wheel_;
+    }
+
+    AccessLog& GetAccessLog()
+    {
+        return access_log_;
+    }
+
 private:
-    std::set<std::shared_ptr<Connection>> connections_;
+    std::atomic<std::size_t> &connection_count_;
+    const ConnectionSettings &settings_;
+    util::WorkerPool *worker_pool_;
+    TimingWheel timing_wheel_;
+    AccessLog access_log_;
+    std::vector<std::shared_ptr<Connection>> connections_;
 };
 
 } // namespace network
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace network {
+
+/**
+ * per io_context pool of connection memory and input buffers.
+ * memory of stopped connections is kept and reused by the next accepted ones
+ * instead of going back to the heap. the pool is only shared by the connections
+ * of one io_context, so the lock is uncontended.
+ */
+class ConnectionPool
+{
+public:
+    struct Stats
+    {
+        std::uint64_t block_hits = 0;
+        std::uint64_t block_misses = 0;
+        std::uint64_t buffer_hits = 0;
+        std::uint64_t buffer_misses = 0;
+    };
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    /**
+     * @param buffer_size size of input buffers
+     * @param max_cached max number of cached blocks and buffers each
+     */
+    explicit ConnectionPool(std::size_t buffer_size = 8192, std::size_t max_cached = 1024)
+      : buffer_size_(buffer_size), max_cached_(max_cached)
+    {}
+
+    ~ConnectionPool()
+    {
+        for (void *block : blocks_)
+        {
+            ::operator delete(block);
+        }
+    }
+
+    void* AllocateBlock(std::size_t size)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (size == block_size_ && !blocks_.empty())
+            {
+                void *block = blocks_.back();
+                blocks_.pop_back();
+                stats_.block_hits++;
+                return block;
+            }
+            stats_.block_misses++;
+        }
+
+        return ::operator new(size);
+    }
+
+    void DeallocateBlock(void *block, std::size_t size)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            // all connections of a pool have the same size, the first one decides
+            if (block_size_ == 0)
+            {
+                block_size_ = size;
+            }
+
+            if (size == block_size_ && blocks_.size() < max_cached_)
+            {
+                blocks_.push_back(block);
+                return;
+            }
+        }
+
+        ::operator delete(block);
+    }
+
+    std::vector<char> AcquireBuffer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!buffers_.empty())
+            {
+                std::vector<char> buffer(std::move(buffers_.back()));
+                buffers_.pop_back();
+                stats_.buffer_hits++;
+                return buffer;
+            }
+            stats_.buffer_misses++;
+        }
+
+        return std::vector<char>(buffer_size_);
+    }
+
+    void ReleaseBuffer(std::vector<char> &&buffer)
+    {
+        // don't keep buffers grown by large requests
+        if (buffer.size() != buffer_size_)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (buffers_.size() < max_cached_)
+        {
+            buffers_.push_back(std::move(buffer));
+        }
+    }
+
+    Stats GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+private:
+    const std::size_t buffer_size_;
+    const std::size_t max_cached_;
+
+    mutable std::mutex mutex_;
+    std::size_t block_size_ = 0;
+    std::vector<void*> blocks_;
+    std::vector<std::vector<char>> buffers_;
+    Stats stats_;
+};
+
+/**
+ * allocator for std::allocate_shared, takes connection and control block memory from a ConnectionPool.
+ * every allocation holds the pool, so the pool outlives all connections allocated from it
+ */
+template<typename T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    explicit PoolAllocator(std::shared_ptr<ConnectionPool> pool) noexcept
+      : pool_(std::move(pool))
+    {}
+
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U> &other) noexcept
+      : pool_(other.GetPool())
+    {}
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(pool_->AllocateBlock(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept
+    {
+        pool_->DeallocateBlock(p, n * sizeof(T));
+    }
+
+    const std::shared_ptr<ConnectionPool>& GetPool() const noexcept
+    {
+        return pool_;
+    }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U> &other) const noexcept
+    {
+        return pool_ == other.GetPool();
+    }
+
+    template<typename U>
+    bool operator!=(const PoolAllocator<U> &other) const noexcept
+    {
+        return pool_ != other.GetPool();
+    }
+
+private:
+    std::shared_ptr<ConnectionPool> pool_;
+};
+
+} // namespace network
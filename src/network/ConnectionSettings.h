@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <chrono>
+
+namespace network {
+
+/**
+ * tunables shared by all connections of a server
+ */
+struct ConnectionSettings
+{
+    /// initial input buffer size, input buffers are pooled in this size
+    std::size_t read_buffer_size = 16 * 1024;
+    /// max input buffer size, a request must fit in it unless its body is streamed
+    std::size_t read_buffer_high_water = 1024 * 1024;
+    /// max request body size, larger requests are answered with 413
+    std::size_t max_body_size = 64 * 1024 * 1024;
+    /// max responses queued on a connection, input is not parsed until some are written
+    std::size_t max_pending_responses = 64;
+    /// max bytes of queued responses gathered into one write
+    std::size_t write_batch_bytes = 1024 * 1024;
+    /// max buffers (iovec entries) gathered into one write
+    std::size_t write_batch_buffers = 64;
+    /// time to receive the request line and headers of a request, timeouts are 0 for none
+    std::chrono::milliseconds header_timeout{10000};
+    /// max time between two reads of a request body
+    std::chrono::milliseconds body_timeout{30000};
+    /// keep-alive, max time to wait for the next request
+    std::chrono::milliseconds idle_timeout{60000};
+    /// max time for one write to complete
+    std::chrono::milliseconds write_timeout{60000};
+    /// max time to wait for the peer to close after the final response
+    std::chrono::milliseconds linger_timeout{5000};
+    /// requests served on one connection before it is closed, 0 for no limit
+    std::size_t max_requests_per_connection = 1000;
+    /// write an access log line for one of this many requests, 0 for none
+    std::size_t access_log_sample = 1;
+    /// max access log lines a second of each io_context, 0 for no limit
+    std::size_t access_log_rate_limit = 1000;
+};
+
+} // namespace network
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+
+namespace network {
+
+/**
+ * fixed capacity input buffer of a connection.
+ * readable data is [read_pos_, write_pos_), Consume only moves read_pos_, and reads go straight
+ * into the free tail. the unread bytes are moved to the front only when the tail is nearly full,
+ * which happens when a partial request straddles the end; data stays contiguous for the parser.
+ * the buffer grows by doubling only if a single request is larger than the capacity,
+ * never beyond high_water.
+ */
+class InputBuffer
+{
+public:
+    /**
+     * @param storage initial storage, its size is the initial capacity
+     * @param high_water max capacity
+     */
+    InputBuffer(std::vector<char> &&storage, std::size_t high_water)
+      : storage_(std::move(storage)),
+        high_water_(high_water < storage_.size() ? storage_.size() : high_water),
+        min_read_size_(storage_.size() / 4)
+    {}
+
+    InputBuffer(const InputBuffer&) = delete;
+    InputBuffer& operator=(const InputBuffer&) = delete;
+
+    const char* Data() const
+    {
+        return storage_.data() + read_pos_;
+    }
+
+    std::size_t Size() const
+    {
+        return write_pos_ - read_pos_;
+    }
+
+    /**
+     * free space to read into, empty if the buffer is full at high water
+     */
+    boost::asio::mutable_buffer Prepare()
+    {
+        if (storage_.size() - write_pos_ < min_read_size_ || write_pos_ == storage_.size())
+        {
+            if (read_pos_ > 0)
+            {
+                std::memmove(storage_.data(), storage_.data() + read_pos_, Size());
+                write_pos_ -= read_pos_;
+                read_pos_ = 0;
+            }
+            else if (storage_.size() < high_water_)
+            {
+                std::size_t capacity = storage_.size() * 2;
+                storage_.resize(capacity < high_water_ ? capacity : high_water_);
+            }
+        }
+
+        return boost::asio::buffer(storage_.data() + write_pos_, storage_.size() - write_pos_);
+    }
+
+    void Commit(std::size_t size)
+    {
+        write_pos_ += size;
+    }
+
+    void Consume(std::size_t size)
+    {
+        read_pos_ += size;
+        if (read_pos_ == write_pos_)
+        {
+            read_pos_ = 0;
+            write_pos_ = 0;
+        }
+    }
+
+    /**
+     * give the storage back, the buffer is empty after it
+     */
+    std::vector<char> Release()
+    {
+        read_pos_ = 0;
+        write_pos_ = 0;
+        return std::move(storage_);
+    }
+
+private:
+    std::vector<char> storage_;
+    const std::size_t high_water_;
+    const std::size_t min_read_size_;
+    std::size_t read_pos_ = 0;
+    std::size_t write_pos_ = 0;
+};
+
+} // namespace network
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+#include <boost/asio.hpp>
+
+namespace network {
+
+/**
+ * hashed timing wheel of one io_context. timers are intrusive nodes kept in the slot
+ * of their expire tick, arm and cancel are O(1) and one steady_timer drives all of them.
+ * only use it from the thread of its io_context
+ */
+class TimingWheel
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * a timer, embedded in its owner. the owner must cancel it before it is destroyed
+     */
+    class Node
+    {
+    public:
+        Node() = default;
+        Node(const Node&) = delete;
+        Node& operator=(const Node&) = delete;
+
+        bool Armed() const
+        {
+            return wheel_ != nullptr;
+        }
+
+        /// called on the io_context thread when the timer expires
+        std::function<void()> callback;
+
+    private:
+        friend class TimingWheel;
+
+        Node *prev_ = nullptr;
+        Node *next_ = nullptr;
+        std::uint64_t expire_tick_ = 0;
+        TimingWheel *wheel_ = nullptr;
+    };
+
+    /**
+     * @param tick resolution of the timers
+     * @param slot_count timers further than slot_count ticks stay in the wheel for more rounds
+     */
+    TimingWheel(boost::asio::io_context &io_context,
+                Clock::duration tick = std::chrono::milliseconds(100),
+                std::size_t slot_count = 1024)
+      : tick_(tick),
+        slots_(slot_count),
+        timer_(io_context),
+        start_(Clock::now())
+    {
+        for (Node &slot : slots_)
+        {
+            slot.prev_ = &slot;
+            slot.next_ = &slot;
+        }
+    }
+
+    ~TimingWheel()
+    {
+        // detach the nodes still armed, their owners may outlive the wheel
+        for (Node &slot : slots_)
+        {
+            while (slot.next_ != &slot)
+            {
+                Unlink(*slot.next_);
+            }
+        }
+    }
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    /**
+     * arm node to expire after timeout, an armed node is moved to the new time
+     */
+    void Arm(Node &node, Clock::duration timeout)
+    {
+        if (node.wheel_ != nullptr)
+        {
+            Unlink(node);
+        }
+
+        // round up, a timer never fires early
+        std::uint64_t ticks = (timeout + tick_ - Clock::duration(1)) / tick_;
+        node.expire_tick_ = std::max(NowTick(), current_tick_) + std::max<std::uint64_t>(ticks, 1);
+        Link(slots_[node.expire_tick_ % slots_.size()], node);
+        node.wheel_ = this;
+        armed_count_++;
+
+        if (!ticking_)
+        {
+            ScheduleTick();
+        }
+    }
+
+    void Cancel(Node &node)
+    {
+        if (node.wheel_ == this)
+        {
+            Unlink(node);
+        }
+    }
+
+    /**
+     * number of armed timers
+     */
+    std::size_t Size() const
+    {
+        return armed_count_;
+    }
+
+private:
+    std::uint64_t NowTick() const
+    {
+        return (Clock::now() - start_) / tick_;
+    }
+
+    static void Link(Node &head, Node &node)
+    {
+        node.prev_ = head.prev_;
+        node.next_ = &head;
+        head.prev_->next_ = &node;
+        head.prev_ = &node;
+    }
+
+    void Unlink(Node &node)
+    {
+        node.prev_->next_ = node.next_;
+        node.next_->prev_ = node.prev_;
+        node.prev_ = nullptr;
+        node.next_ = nullptr;
+        node.wheel_ = nullptr;
+        armed_count_--;
+    }
+
+    void ScheduleTick()
+    {
+        ticking_ = true;
+        timer_.expires_at(start_ + (current_tick_ + 1) * tick_);
+        timer_.async_wait(
+            [this](boost::system::error_code ec)
+            {
+                // aborted when the wheel is destroyed, this is gone
+                if (ec)
+                {
+                    return;
+                }
+                ticking_ = false;
+                Tick();
+            });
+    }
+
+    void Tick()
+    {
+        std::uint64_t now_tick = NowTick();
+
+        // collect the expired nodes first, a callback may arm or cancel other nodes
+        Node expired;
+        expired.prev_ = &expired;
+        expired.next_ = &expired;
+        std::uint64_t ticks = std::min<std::uint64_t>(now_tick - current_tick_, slots_.size());
+        for (std::uint64_t i = 1; i <= ticks; i++)
+        {
+            Node &slot = slots_[(current_tick_ + i) % slots_.size()];
+            Node *node = slot.next_;
+            while (node != &slot)
+            {
+                Node *next = node->next_;
+                if (node->expire_tick_ <= now_tick)
+                {
+                    node->prev_->next_ = node->next_;
+                    node->next_->prev_ = node->prev_;
+                    Link(expired, *node);
+                }
+                node = next;
+            }
+        }
+        current_tick_ = std::max(current_tick_, now_tick);
+
+        while (expired.next_ != &expired)
+        {
+            Node &node = *expired.next_;
+            Unlink(node);
+            node.callback();
+        }
+
+        if (armed_count_ > 0 && !ticking_)
+        {
+            ScheduleTick();
+        }
+    }
+
+    Clock::duration tick_;
+    std::vector<Node> slots_; // list heads
+    boost::asio::steady_timer timer_;
+    Clock::time_point start_;
+    std::uint64_t current_tick_ = 0; // slots up to this tick are processed
+    std::size_t armed_count_ = 0;
+    bool ticking_ = false;
+};
+
+} // namespace network
@@ -5,12 +5,18 @@
 #include <sstream>
 #include <unordered_map>
 #include <optional>
+#include <charconv>
+#include <array>
+#include <algorithm>
+#include <functional>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/container/small_vector.hpp>
 
 #include "log/log.h"
+#include "utils/WorkerPool.h"
 #include "Protocol.h"
-#include "utils/TemplateHelper.h"
+#include "HttpScanner.h"
 
 
 namespace network {
@@ -23,11 +29,36 @@ struct Header
     std::string value;
 };
 
+// request header, name and value point into the connection input buffer
+struct HeaderView
+{
+    std::string_view name;
+    std::string_view value;
+};
+
 using Headers = std::unordered_map<std::string, std::string>;
+// request headers are stored inline, a typical request never allocates
+using HeaderViews = boost::container::small_vector<HeaderView, 32>;
 static const std::string CR = "\r";
 static const std::string LF = "\n";
 static const std::string CRLF = "\r\n";
 
+// common header names
+static constexpr std::string_view CONTENT_LENGTH = "Content-Length";
+static constexpr std::string_view CONTENT_LENGTH_PREFIX = "Content-Length:";
+static constexpr std::string_view CONNECTION = "Connection";
+static constexpr std::string_view CONNECTION_CLOSE = "Connection:close\r\n";
+static constexpr std::string_view CONNECTION_KEEP_ALIVE = "Connection:keep-alive\r\n";
+static constexpr std::string_view HTTP_1_0 = "HTTP/1.0";
+static constexpr std::string_view TRANSFER_ENCODING = "Transfer-Encoding";
+static constexpr std::string_view TRANSFER_ENCODING_CHUNKED = "Transfer-Encoding:chunked\r\n";
+static constexpr std::string_view CHUNKED = "chunked";
+static constexpr std::string_view LAST_CHUNK = "0\r\n\r\n";
+
+// request versions as Http::GetVersion numbers them
+static constexpr int VERSION_1_0 = 10;
+static constexpr int VERSION_1_1 = 11;
+
 // case insensitive find header
 inline std::optional<Header>
 ifind_header(const Headers &headers, const std::string &name)
@@ -42,23 +73,61 @@ ifind_header(const Headers &headers, const std::string &name)
     return std::nullopt;
 }
 
+// case insensitive find request header
+inline const HeaderView*
+ifind_header(const HeaderViews &headers, std::string_view name)
+{
+    for (const auto &header : headers)
+    {
+        if (header.name.size() == name.size() && boost::iequals(header.name, name))
+        {
+            return &header;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * all fields are views into the connection input buffer,
+ * they are only valid until the handler returns
+ */
 class Request
 {
 public:
-    std::string method;
-    std::string uri;
-    std::string version;
-    Headers headers;
-    std::string body;
-    std::size_t content_length = 0;
+    std::string_view method;
+    std::string_view uri;
+    std::string_view version;
+    HeaderViews headers;
+    std::string_view body;
+    std::size_t content_length = 0; // body size, known after the body is parsed if chunked
 
-    std::string to_string()
+    std::optional<std::string_view> GetHeader(std::string_view name) const
+    {
+        const HeaderView *header = ifind_header(headers, name);
+        if (header == nullptr)
+        {
+            return std::nullopt;
+        }
+        return header->value;
+    }
+
+    void Clear()
+    {
+        method = std::string_view();
+        uri = std::string_view();
+        version = std::string_view();
+        headers.clear();
+        body = std::string_view();
+        content_length = 0;
+    }
+
+    std::string to_string() const
     {
         std::stringstream ss;
         ss << method << " " << uri << " ";
         for (const auto &header : headers)
         {
-            ss << header.first << ":" << header.second << " ";
+            ss << header.name << ":" << header.value << " ";
         }
         ss << body;
         return ss.str();
@@ -108,6 +177,7 @@ public:
         UnsupportedMediaType            = 415,
         RequestedRangeNotSatisfiable    = 416,
         ExpectationFailed               = 417,
+        RequestHeaderFieldsTooLarge     = 431,
         /* 5xx: Server Error - The server failed to fulfill an apparently valid request */
         InternalServerError             = 500,
         NotImplemented                  = 501,
@@ -117,59 +187,26 @@ public:
         HTTPVersionNotSupported         = 505
     };
 
-    static std::string GetReasonPhrase(const StatusCode& status_code)
-    {
-        static const std::unordered_map<
-                        StatusCode, std::string, util::EnumClassHash> status_reason_map = {
-            {StatusCode::Continue                     ,"Continue"},
-            {StatusCode::SwitchingProtocols           ,"Switching Protocols"},
-            {StatusCode::OK                           ,"OK"},
-            {StatusCode::Created                      ,"Created"},
-            {StatusCode::Accepted                     ,"Accepted"},
-            {StatusCode::NonAuthoritativeInformation  ,"Non-Authoritative Information"},
-            {StatusCode::NoContent                    ,"No Content"},
-            {StatusCode::ResetContent                 ,"Reset Content"},
-            {StatusCode::PartialContent               ,"Partial Content"},
-            {StatusCode::MultipleChoices              ,"Multiple Choices"},
-            {StatusCode::MovedPermanently             ,"Moved Permanently"},
-            {StatusCode::Found                        ,"Found"},
-            {StatusCode::SeeOther                     ,"See Other"},
-            {StatusCode::NotModified                  ,"Not Modified"},
-            {StatusCode::UseProxy                     ,"Use Proxy"},
-            {StatusCode::TemporaryRedirect            ,"Temporary Redirect"},
-            {StatusCode::BadRequest                   ,"Bad Request"},
-            {StatusCode::Unauthorized                 ,"Unauthorized"},
-            {StatusCode::PaymentRequired              ,"Payment Required"},
-            {StatusCode::Forbidden                    ,"Forbidden"},
-            {StatusCode::NotFound                     ,"Not Found"},
-            {StatusCode::MethodNotAllowed             ,"Method Not Allowed"},
-            {StatusCode::NotAcceptable                ,"Not Acceptable"},
-            {StatusCode::ProxyAuthenticationRequired  ,"Proxy Authentication Required"},
-            {StatusCode::RequestTimeout               ,"Request Time-out"},
-            {StatusCode::Conflict                     ,"Conflict"},
-            {StatusCode::Gone                         ,"Gone"},
-            {StatusCode::LengthRequired               ,"Length Required"},
-            {StatusCode::PreconditionFailed           ,"Precondition Failed"},
-            {StatusCode::RequestEntityTooLarge        ,"Request Entity Too Large"},
-            {StatusCode::RequestURITooLarge           ,"Request-URI Too Large"},
-            {StatusCode::UnsupportedMediaType         ,"Unsupported Media Type"},
-            {StatusCode::RequestedRangeNotSatisfiable ,"Requested range not satisfiable"},
-            {StatusCode::ExpectationFailed            ,"Expectation Failed"},
-            {StatusCode::InternalServerError          ,"Internal Server Error"},
-            {StatusCode::NotImplemented               ,"Not Implemented"},
-            {StatusCode::BadGateway                   ,"Bad Gateway"},
-            {StatusCode::ServiceUnavailable           ,"Service Unavailable"},
-            {StatusCode::GatewayTimeout               ,"Gateway Time-out"},
-            {StatusCode::HTTPVersionNotSupported      ,"HTTP Version not supported"}
-        };
-
-        const auto& it = status_reason_map.find(status_code);
-        if (it != status_reason_map.end())
-        {
-            return it->second;
-        }
-
-        return "";
+    /**
+     * fully formatted status line, "HTTP/1.1 200 OK\r\n".
+     * return empty string for unknown status code
+     */
+    static constexpr std::string_view GetStatusLine(StatusCode status_code)
+    {
+        auto code = static_cast<std::size_t>(status_code);
+        return code < status_lines_.size() ? status_lines_[code] : std::string_view();
+    }
+
+    static constexpr std::string_view GetReasonPhrase(StatusCode status_code)
+    {
+        // skip "HTTP/1.1 200 " and the ending CRLF
+        constexpr std::size_t prefix_size = 13;
+        std::string_view status_line = GetStatusLine(status_code);
+        if (status_line.empty())
+        {
+            return status_line;
+        }
+        return status_line.substr(prefix_size, status_line.size() - prefix_size - 2);
     }
 
     std::string to_string()
@@ -187,63 +224,264 @@ public:
     StatusCode status_code;
     Headers headers;
     std::string body;
+    /**
+     * if set, body is ignored and the body is sent with chunked transfer coding,
+     * or to HTTP/1.0 clients as is until the connection closes. Content-Length and
+     * Transfer-Encoding of headers are not sent then.
+     * it is called whenever the connection can send more, it appends the next part
+     * of the body to out and returns DONE after the last part. if nothing is ready it
+     * returns PENDING and calls (a copy of) resume later, it is not called until then.
+     * MORE must append data, without data it is taken as PENDING
+     */
+    std::function<BodyState(std::string &out, const Resumer &resume)> body_producer;
+
+private:
+    struct StatusLine
+    {
+        StatusCode status_code;
+        std::string_view line;
+    };
+
+    static constexpr StatusLine status_line_list_[] = {
+            {StatusCode::Continue                     ,"HTTP/1.1 100 Continue\r\n"},
+            {StatusCode::SwitchingProtocols           ,"HTTP/1.1 101 Switching Protocols\r\n"},
+            {StatusCode::OK                           ,"HTTP/1.1 200 OK\r\n"},
+            {StatusCode::Created                      ,"HTTP/1.1 201 Created\r\n"},
+            {StatusCode::Accepted                     ,"HTTP/1.1 202 Accepted\r\n"},
+            {StatusCode::NonAuthoritativeInformation  ,"HTTP/1.1 203 Non-Authoritative Information\r\n"},
+            {StatusCode::NoContent                    ,"HTTP/1.1 204 No Content\r\n"},
+            {StatusCode::ResetContent                 ,"HTTP/1.1 205 Reset Content\r\n"},
+            {StatusCode::PartialContent               ,"HTTP/1.1 206 Partial Content\r\n"},
+            {StatusCode::MultipleChoices              ,"HTTP/1.1 300 Multiple Choices\r\n"},
+            {StatusCode::MovedPermanently             ,"HTTP/1.1 301 Moved Permanently\r\n"},
+            {StatusCode::Found                        ,"HTTP/1.1 302 Found\r\n"},
+            {StatusCode::SeeOther                     ,"HTTP/1.1 303 See Other\r\n"},
+            {StatusCode::NotModified                  ,"HTTP/1.1 304 Not Modified\r\n"},
+            {StatusCode::UseProxy                     ,"HTTP/1.1 305 Use Proxy\r\n"},
+            {StatusCode::TemporaryRedirect            ,"HTTP/1.1 307 Temporary Redirect\r\n"},
+            {StatusCode::BadRequest                   ,"HTTP/1.1 400 Bad Request\r\n"},
+            {StatusCode::Unauthorized                 ,"HTTP/1.1 401 Unauthorized\r\n"},
+            {StatusCode::PaymentRequired              ,"HTTP/1.1 402 Payment Required\r\n"},
+            {StatusCode::Forbidden                    ,"HTTP/1.1 403 Forbidden\r\n"},
+            {StatusCode::NotFound                     ,"HTTP/1.1 404 Not Found\r\n"},
+            {StatusCode::MethodNotAllowed             ,"HTTP/1.1 405 Method Not Allowed\r\n"},
+            {StatusCode::NotAcceptable                ,"HTTP/1.1 406 Not Acceptable\r\n"},
+            {StatusCode::ProxyAuthenticationRequired  ,"HTTP/1.1 407 Proxy Authentication Required\r\n"},
+            {StatusCode::RequestTimeout               ,"HTTP/1.1 408 Request Time-out\r\n"},
+            {StatusCode::Conflict                     ,"HTTP/1.1 409 Conflict\r\n"},
+            {StatusCode::Gone                         ,"HTTP/1.1 410 Gone\r\n"},
+            {StatusCode::LengthRequired               ,"HTTP/1.1 411 Length Required\r\n"},
+            {StatusCode::PreconditionFailed           ,"HTTP/1.1 412 Precondition Failed\r\n"},
+            {StatusCode::RequestEntityTooLarge        ,"HTTP/1.1 413 Request Entity Too Large\r\n"},
+            {StatusCode::RequestURITooLarge           ,"HTTP/1.1 414 Request-URI Too Large\r\n"},
+            {StatusCode::UnsupportedMediaType         ,"HTTP/1.1 415 Unsupported Media Type\r\n"},
+            {StatusCode::RequestedRangeNotSatisfiable ,"HTTP/1.1 416 Requested range not satisfiable\r\n"},
+            {StatusCode::ExpectationFailed            ,"HTTP/1.1 417 Expectation Failed\r\n"},
+            {StatusCode::RequestHeaderFieldsTooLarge  ,"HTTP/1.1 431 Request Header Fields Too Large\r\n"},
+            {StatusCode::InternalServerError          ,"HTTP/1.1 500 Internal Server Error\r\n"},
+            {StatusCode::NotImplemented               ,"HTTP/1.1 501 Not Implemented\r\n"},
+            {StatusCode::BadGateway                   ,"HTTP/1.1 502 Bad Gateway\r\n"},
+            {StatusCode::ServiceUnavailable           ,"HTTP/1.1 503 Service Unavailable\r\n"},
+            {StatusCode::GatewayTimeout               ,"HTTP/1.1 504 Gateway Time-out\r\n"},
+            {StatusCode::HTTPVersionNotSupported      ,"HTTP/1.1 505 HTTP Version not supported\r\n"}
+    };
+
+    // status lines indexed by status code, built at compile time
+    static constexpr std::array<std::string_view, 600> status_lines_ = []()
+    {
+        std::array<std::string_view, 600> status_lines{};
+        for (const auto &status_line : status_line_list_)
+        {
+            status_lines[static_cast<std::size_t>(status_line.status_code)] = status_line.line;
+        }
+        return status_lines;
+    }();
 };
 
+/**
+ * completes an asynchronous request, it can be called once from any thread.
+ * it is a no-op if the connection is closed already
+ */
+using Responder = std::function<void(Response response)>;
+
 class Handler
 {
 public:
+    /**
+     * worker pool of the server, nullptr if there is none. an async handler can post
+     * cpu bound work to pool->GetExecutor() when pool->HasExecutor(), and respond from there
+     */
+    util::WorkerPool* worker_pool() const
+    {
+        return worker_pool_;
+    }
+
+    void set_worker_pool(util::WorkerPool *worker_pool)
+    {
+        worker_pool_ = worker_pool;
+    }
+
     virtual void handle(const Request& request, Response& response) noexcept
     {
         response.status_code = Response::StatusCode::OK;
     }
+
+    /**
+     * return true to run handle on the worker pool. the connection doesn't parse more
+     * requests until it returns, so request stays valid, but handle must be thread safe
+     * to what it shares with other connections
+     */
+    virtual bool is_cpu_bound(const Request& request) noexcept
+    {
+        return false;
+    }
+
+    /**
+     * return true to complete the request by handle_async instead of handle
+     */
+    virtual bool is_async(const Request& request) noexcept
+    {
+        return false;
+    }
+
+    /**
+     * start an asynchronous request. request is only valid until it returns, copy what is
+     * needed later. the connection keeps reading and handling pipelined requests while
+     * it runs, responses are still sent in request order
+     */
+    virtual void handle_async(const Request& request, Responder responder) noexcept
+    {
+        Response response;
+        handle(request, response);
+        responder(std::move(response));
+    }
+
+    /**
+     * called when the headers of a request with body are parsed, return true to receive
+     * the body by on_body in chunks instead of in request.body
+     */
+    virtual bool stream_body(const Request& request) noexcept
+    {
+        return false;
+    }
+
+    /**
+     * a chunk of a streamed body, call done once from any thread when it is processed.
+     * chunk and request stay valid and the connection reads no more until then,
+     * so a slow handler slows down the client instead of buffering the body,
+     * and the io thread serves other connections meanwhile.
+     * handle is called after the last chunk, with an empty request.body
+     */
+    virtual void on_body(const Request& request, std::string_view chunk, Resumer done) noexcept
+    {
+        done();
+    }
+
+private:
+    util::WorkerPool *worker_pool_ = nullptr;
 };
 
 class Http : public Protocol<Request, Response, Handler>
 {
 public:
     Http()
-      : parse_status_(ParseStatus::REQUEST_LINE)
+      : parse_status_(ParseStatus::HEADERS)
     {}
 
     std::tuple<ParseResult, std::size_t>
-    Parse(Request &request, const char *data, std::size_t size) override
+    Parse(Request &request, Handler &handler, const ResumerFactory &make_resumer,
+          const char *data, std::size_t size) override
     {
-        ParseResult result = ParseResult::NEED_MORE;
-        std::size_t totoal_used_bytes = 0;
-        std::size_t used_bytes = 0;
-
         switch (parse_status_)
         {
-        case ParseStatus::REQUEST_LINE:
-            std::tie(result, used_bytes) = ParseRequestLine(request, data, size);
-            totoal_used_bytes += used_bytes;
-            if (result == ParseResult::GOOD)
+        case ParseStatus::HEADERS:
+        {
+            std::size_t header_size = FindHeaderEnd(data, size);
+            if (header_size == 0)
             {
-                parse_status_ = ParseStatus::HEADERS;
+                // the largest input buffer is full and the header block doesn't end in it
+                if (size >= max_buffered_size_)
+                {
+                    Reset();
+                    headers_too_large_ = true;
+                    return std::make_tuple(ParseResult::TOO_LARGE, 0);
+                }
+                return std::make_tuple(ParseResult::NEED_MORE, 0);
             }
-            else
+
+            header_size_ = header_size;
+            if (!ParseHeaderBlock(request, data))
             {
-                return std::make_tuple(result, totoal_used_bytes);
+                Reset();
+                return std::make_tuple(ParseResult::BAD, 0);
             }
-        case ParseStatus::HEADERS:
-            std::tie(result, used_bytes) = ParseHeaders(request, data + totoal_used_bytes, size - totoal_used_bytes);
-            totoal_used_bytes += used_bytes;
-            if (result == ParseResult::GOOD)
+
+            if (request.content_length > max_body_size_)
             {
-                parse_status_ = ParseStatus::BODY;
+                Reset();
+                return std::make_tuple(ParseResult::TOO_LARGE, 0);
             }
-            else
+
+            if (chunked_)
             {
-                return std::make_tuple(result, totoal_used_bytes);
+                // chunks are consumed as they are decoded, keep a copy of headers
+                header_storage_.assign(data, header_size_);
+                ParseHeaderBlock(request, header_storage_.data());
+                stream_chunks_ = handler.stream_body(request);
+                body_storage_.clear();
+                parse_status_ = ParseStatus::CHUNK_SIZE;
+                return ParseChunked(request, handler, make_resumer,
+                                    data + header_size_, size - header_size_, header_size_);
             }
-        case ParseStatus::BODY:
-            std::tie(result, used_bytes) = ParseBody(request, data + totoal_used_bytes, size - totoal_used_bytes);
-            totoal_used_bytes += used_bytes;
-            if (result == ParseResult::GOOD)
+
+            if (request.content_length > 0 && handler.stream_body(request))
+            {
+                // the input buffer is consumed while the body streams, keep a copy of headers
+                header_storage_.assign(data, header_size_);
+                ParseHeaderBlock(request, header_storage_.data());
+                body_remain_ = request.content_length;
+                parse_status_ = ParseStatus::BODY_STREAM;
+                return ParseBodyChunk(request, handler, make_resumer,
+                                      data + header_size_, size - header_size_, header_size_);
+            }
+
+            if (header_size_ + request.content_length > max_buffered_size_)
             {
                 Reset();
+                return std::make_tuple(ParseResult::TOO_LARGE, 0);
+            }
+
+            header_base_ = data;
+            parse_status_ = ParseStatus::BODY;
+        }
+        // fall through
+        case ParseStatus::BODY:
+        {
+            // nothing is consumed until the whole request arrived,
+            // so all fields of request can point into data
+            std::size_t request_size = header_size_ + request.content_length;
+            if (size < request_size)
+            {
+                return std::make_tuple(ParseResult::NEED_MORE, 0);
+            }
+
+            // input buffer was reallocated, rebuild views
+            if (data != header_base_)
+            {
+                ParseHeaderBlock(request, data);
             }
-            return std::make_tuple(result, totoal_used_bytes);
+
+            request.body = std::string_view(data + header_size_, request.content_length);
+            Reset();
+            return std::make_tuple(ParseResult::GOOD, request_size);
+        }
+        case ParseStatus::BODY_STREAM:
+            return ParseBodyChunk(request, handler, make_resumer, data, size, 0);
+        case ParseStatus::CHUNK_SIZE:
+        case ParseStatus::CHUNK_DATA:
+        case ParseStatus::CHUNK_DATA_END:
+        case ParseStatus::CHUNK_TRAILER:
+            return ParseChunked(request, handler, make_resumer, data, size, 0);
         default:
             LOG_ERROR("unknown parse status %d", parse_status_);
             break;
@@ -252,173 +490,565 @@ public:
         return std::make_tuple(ParseResult::BAD, 0);
     }
 
-    void Serialize(const Response &response, boost::asio::streambuf &streambuf) override
+    KeepAlive GetKeepAlive(const Request &request) const override
+    {
+        // HTTP/1.1 connections are persistent unless closed, HTTP/1.0 ones only on request
+        auto connection = request.GetHeader(CONNECTION);
+        if (connection && HasToken(*connection, "close"))
+        {
+            return KeepAlive::CLOSE;
+        }
+        if (request.version == HTTP_1_0)
+        {
+            return (connection && HasToken(*connection, "keep-alive")) ?
+                    KeepAlive::ANNOUNCE : KeepAlive::CLOSE;
+        }
+        return KeepAlive::DEFAULT;
+    }
+
+    void DescribeRequest(const Request &request, std::string &out) const override
+    {
+        out.append(request.method).append(" ").append(request.uri);
+    }
+
+    int GetStatus(const Response &response) const override
+    {
+        return static_cast<int>(response.status_code);
+    }
+
+    int GetVersion(const Request &request) const override
+    {
+        return (request.version == HTTP_1_0) ? VERSION_1_0 : VERSION_1_1;
+    }
+
+    bool IsReadingBody() const override
+    {
+        return parse_status_ != ParseStatus::HEADERS;
+    }
+
+    void MakeErrorResponse(ParseResult result, Response &response) override
+    {
+        if (result == ParseResult::TOO_LARGE)
+        {
+            response.status_code = headers_too_large_ ?
+                                   Response::StatusCode::RequestHeaderFieldsTooLarge :
+                                   Response::StatusCode::RequestEntityTooLarge;
+        }
+        else
+        {
+            response.status_code = Response::StatusCode::BadRequest;
+        }
+        headers_too_large_ = false;
+    }
+
+    boost::asio::const_buffer
+    Serialize(const Response &response, KeepAlive &keep_alive, int version, std::string &head) override
     {
-        std::ostream os(&streambuf);
         // Status-Line = HTTP-Version SP Status-Code SP Reason-Phrase CRLF
-        os << "HTTP/1.1" << " " << static_cast<std::underlying_type_t<Response::StatusCode>>(response.status_code)
-           << " " << Response::GetReasonPhrase(response.status_code) << CRLF;
+        std::string_view status_line = Response::GetStatusLine(response.status_code);
+        if (!status_line.empty())
+        {
+            head.append(status_line);
+        }
+        else
+        {
+            head.append("HTTP/1.1 ");
+            AppendNumber(head, static_cast<std::underlying_type_t<Response::StatusCode>>(response.status_code));
+            head.append(" ").append(CRLF);
+        }
+
+        // a streamed body is chunked, HTTP/1.0 clients can't decode that (RFC 7230 3.3.1),
+        // they get the body as is and it ends when the connection closes
+        bool streamed = IsStreamed(response);
+        bool chunked = streamed && version != VERSION_1_0;
+        if (streamed && !chunked)
+        {
+            keep_alive = KeepAlive::CLOSE;
+        }
 
         // Headers
+        bool has_content_length = false;
+        bool has_connection = false;
         for (const auto& header : response.headers)
         {
-            os << header.first << ":" << header.second << CRLF;
+            bool is_content_length =
+                header.first.size() == CONTENT_LENGTH.size() && boost::iequals(header.first, CONTENT_LENGTH);
+            bool is_connection =
+                header.first.size() == CONNECTION.size() && boost::iequals(header.first, CONNECTION);
+            // the framing of a streamed body is ours
+            if (streamed && (is_content_length || boost::iequals(header.first, TRANSFER_ENCODING) ||
+                             (!chunked && is_connection)))
+            {
+                continue;
+            }
+
+            head.append(header.first).append(":").append(header.second).append(CRLF);
+            has_content_length = has_content_length || is_content_length;
+            has_connection = has_connection || is_connection;
         }
 
-        auto content_length_header = ifind_header(response.headers, "Content-Length");
-        if (!content_length_header)
+        if (!has_connection && keep_alive != KeepAlive::DEFAULT)
         {
-            os << "Content-Length" << ":" << std::to_string(response.body.size()) << CRLF;
+            head.append(keep_alive == KeepAlive::CLOSE ? CONNECTION_CLOSE : CONNECTION_KEEP_ALIVE);
         }
 
-        os << CRLF;
+        if (chunked)
+        {
+            head.append(TRANSFER_ENCODING_CHUNKED);
+        }
+        else if (!streamed && !has_content_length)
+        {
+            head.append(CONTENT_LENGTH_PREFIX);
+            AppendNumber(head, response.body.size());
+            head.append(CRLF);
+        }
+
+        head.append(CRLF);
+
+        if (streamed)
+        {
+            return boost::asio::const_buffer();
+        }
 
-        // body
-        os << response.body;
+        // body is sent from response directly
+        return boost::asio::buffer(response.body);
     }
 
-private:
-    std::tuple<ParseResult, std::size_t>
-    ParseRequestLine(Request &request, const char *data, std::size_t size)
+    bool IsStreamed(const Response &response) override
     {
-        //Request-Line = Method SP Request-URI SP HTTP-Version CRLF
-        std::string_view req_str(data, size);
-        std::string_view::size_type pos = req_str.find(CRLF);
-        if (pos == std::string_view::npos)
+        return static_cast<bool>(response.body_producer);
+    }
+
+    BodyState SerializeChunk(Response &response, int version, const Resumer &resume, std::string &out) override
+    {
+        if (version == VERSION_1_0)
         {
-            return std::make_tuple(ParseResult::NEED_MORE, 0);
+            return response.body_producer(out, resume);
         }
-        std::size_t used_bytes = pos + CRLF.size();
-        std::string_view request_line(data, pos);
 
-        // method
-        pos = request_line.find(" ");
-        if (pos == std::string_view::npos)
+        // chunk-size is written with leading zeros after the data is produced,
+        // so the producer appends to out directly
+        std::size_t size_pos = out.size();
+        out.append(CHUNK_SIZE_WIDTH, '0').append(CRLF);
+        std::size_t data_pos = out.size();
+        BodyState state = response.body_producer(out, resume);
+
+        std::size_t data_size = out.size() - data_pos;
+        if (data_size == 0)
+        {
+            // an empty chunk would end the body
+            out.resize(size_pos);
+        }
+        else
         {
-            return std::make_tuple(ParseResult::BAD, 0);
+            char buffer[CHUNK_SIZE_WIDTH];
+            auto result = std::to_chars(buffer, buffer + sizeof(buffer), data_size, 16);
+            std::size_t digits = result.ptr - buffer;
+            out.replace(size_pos + CHUNK_SIZE_WIDTH - digits, digits, buffer, digits);
+            out.append(CRLF);
         }
 
-        std::string method(request_line, 0, pos);
-        request_line.remove_prefix(pos + 1);
-        // TODO: check method
+        if (state == BodyState::DONE)
+        {
+            // last-chunk, no trailer
+            out.append(LAST_CHUNK);
+        }
+        return state;
+    }
 
-        // uri
-        pos = request_line.find(" ");
-        if (pos == std::string_view::npos)
+private:
+    /**
+     * find the empty line ends the header block, return header block size or 0 if need more data.
+     * scanning resumes where the last call stopped, a request arriving in pieces is scanned once
+     */
+    std::size_t FindHeaderEnd(const char *data, std::size_t size)
+    {
+        std::size_t pos = scanned_size_;
+        while (pos < size)
+        {
+            pos += FindFirstOf(data + pos, size - pos, LF_SET);
+            if (pos == size)
+            {
+                break;
+            }
+
+            if (pos + CRLF.size() >= size)
+            {
+                // check this LF again when more data arrives
+                scanned_size_ = pos;
+                return 0;
+            }
+
+            // CRLF CRLF
+            if (pos > 0 && data[pos - 1] == '\r' && data[pos + 1] == '\r' && data[pos + 2] == '\n')
+            {
+                return pos + 1 + CRLF.size();
+            }
+            pos++;
+        }
+
+        scanned_size_ = size;
+        return 0;
+    }
+
+    // pass the received part of a streamed body to handler, used_bytes are bytes used before data
+    std::tuple<ParseResult, std::size_t>
+    ParseBodyChunk(Request &request, Handler &handler, const ResumerFactory &make_resumer,
+                   const char *data, std::size_t size, std::size_t used_bytes)
+    {
+        std::size_t chunk_size = std::min(size, body_remain_);
+        if (chunk_size > 0)
         {
-            return std::make_tuple(ParseResult::BAD, 0);
+            body_remain_ -= chunk_size;
+            used_bytes += chunk_size;
+            // the end of the body is returned by the Parse after the handler is done
+            handler.on_body(request, std::string_view(data, chunk_size), make_resumer());
+            return std::make_tuple(ParseResult::PAUSED, used_bytes);
         }
-        std::string uri(request_line, 0, pos);
-        request_line.remove_prefix(pos + 1);
 
-        // version
-        pos = request_line.find("HTTP/");
-        if (pos == std::string_view::npos)
+        if (body_remain_ > 0)
         {
-            return std::make_tuple(ParseResult::BAD, 0);
+            return std::make_tuple(ParseResult::NEED_MORE, used_bytes);
         }
-        std::string version(request_line);
 
-        request.method = method;
-        request.uri = uri;
-        request.version = version;
+        request.body = std::string_view();
+        Reset();
         return std::make_tuple(ParseResult::GOOD, used_bytes);
     }
 
+    /**
+     * decode a chunked body, used_bytes are bytes used before data.
+     * the decoded data goes to handler.on_body if the body is streamed or body_storage_
+     */
     std::tuple<ParseResult, std::size_t>
-    ParseHeaders(Request &request, const char *data, std::size_t size)
+    ParseChunked(Request &request, Handler &handler, const ResumerFactory &make_resumer,
+                 const char *data, std::size_t size, std::size_t used_bytes)
     {
-        std::string_view req_str(data, size);
-        std::size_t used_bytes = 0;
-
-        while (req_str.size() > 0)
+        const char *pos = data;
+        const char *end = data + size;
+        while (true)
         {
-            auto pos = req_str.find(CRLF);
-            if (pos == std::string_view::npos)
+            switch (parse_status_)
             {
-                return std::make_tuple(ParseResult::NEED_MORE, used_bytes);
+            case ParseStatus::CHUNK_SIZE:
+            {
+                // chunk-size [ chunk-ext ] CRLF
+                std::string_view line;
+                ParseResult result = ReadLine(pos, end, line);
+                if (result != ParseResult::GOOD)
+                {
+                    return MakeChunkedResult(result, used_bytes + (pos - data));
+                }
+
+                line = Trim(line.substr(0, line.find(';')));
+                auto [ptr, ec] = std::from_chars(line.data(), line.data() + line.size(), chunk_remain_, 16);
+                if (line.empty() || ec != std::errc() || ptr != line.data() + line.size())
+                {
+                    LOG_ERROR("invalid chunk size %s", line);
+                    return MakeChunkedResult(ParseResult::BAD, 0);
+                }
+
+                if (chunk_remain_ == 0)
+                {
+                    parse_status_ = ParseStatus::CHUNK_TRAILER;
+                    break;
+                }
+                if (chunk_remain_ > max_body_size_ - request.content_length ||
+                    (!stream_chunks_ && chunk_remain_ > max_buffered_size_ - request.content_length))
+                {
+                    return MakeChunkedResult(ParseResult::TOO_LARGE, 0);
+                }
+                parse_status_ = ParseStatus::CHUNK_DATA;
+                break;
             }
-            std::size_t header_len = pos;
-            if (header_len == 0)
+            case ParseStatus::CHUNK_DATA:
             {
-                used_bytes += CRLF.size();
-                // if get body length failed, return ParseResult::BAD
-                request.content_length = GetBodyLength(request);
-                return std::make_tuple(ParseResult::GOOD, used_bytes);
+                std::size_t chunk_size = std::min(static_cast<std::size_t>(end - pos), chunk_remain_);
+                if (chunk_size == 0)
+                {
+                    return MakeChunkedResult(ParseResult::NEED_MORE, used_bytes + (pos - data));
+                }
+
+                const char *chunk = pos;
+                if (!stream_chunks_)
+                {
+                    body_storage_.append(pos, chunk_size);
+                }
+                pos += chunk_size;
+                chunk_remain_ -= chunk_size;
+                request.content_length += chunk_size;
+                if (chunk_remain_ == 0)
+                {
+                    parse_status_ = ParseStatus::CHUNK_DATA_END;
+                }
+                if (stream_chunks_)
+                {
+                    handler.on_body(request, std::string_view(chunk, chunk_size), make_resumer());
+                    return MakeChunkedResult(ParseResult::PAUSED, used_bytes + (pos - data));
+                }
+                break;
             }
-            std::string_view header(req_str.substr(0, pos));
-            pos = header.find(":");
-            if (pos == std::string_view::npos)
+            case ParseStatus::CHUNK_DATA_END:
             {
-                return std::make_tuple(ParseResult::BAD, used_bytes);
+                if (end - pos < static_cast<std::ptrdiff_t>(CRLF.size()))
+                {
+                    return MakeChunkedResult(ParseResult::NEED_MORE, used_bytes + (pos - data));
+                }
+                if (pos[0] != '\r' || pos[1] != '\n')
+                {
+                    return MakeChunkedResult(ParseResult::BAD, 0);
+                }
+                pos += CRLF.size();
+                parse_status_ = ParseStatus::CHUNK_SIZE;
+                break;
             }
-            std::string header_name{header.substr(0, pos)};
-            std::string header_value{header.substr(pos + 1)};
-            boost::trim(header_name);
-            boost::trim(header_value);
-            request.headers[header_name] = header_value;
+            case ParseStatus::CHUNK_TRAILER:
+            {
+                // trailer fields are ignored, the empty line ends the body
+                std::string_view line;
+                ParseResult result = ReadLine(pos, end, line);
+                if (result != ParseResult::GOOD)
+                {
+                    return MakeChunkedResult(result, used_bytes + (pos - data));
+                }
+                if (!line.empty())
+                {
+                    break;
+                }
 
-            used_bytes += (header_len + CRLF.size());
-            req_str.remove_prefix(header_len + CRLF.size());
+                request.body = stream_chunks_ ? std::string_view() : std::string_view(body_storage_);
+                return MakeChunkedResult(ParseResult::GOOD, used_bytes + (pos - data));
+            }
+            default:
+                return MakeChunkedResult(ParseResult::BAD, 0);
+            }
         }
+    }
 
-        return std::make_tuple(ParseResult::NEED_MORE, used_bytes);
+    std::tuple<ParseResult, std::size_t> MakeChunkedResult(ParseResult result, std::size_t used_bytes)
+    {
+        if (result != ParseResult::NEED_MORE && result != ParseResult::PAUSED)
+        {
+            Reset();
+        }
+        return std::make_tuple(result, used_bytes);
     }
 
-    std::tuple<ParseResult, std::size_t>
-    ParseBody(Request &request, const char *data, std::size_t size)
+    /**
+     * read a CRLF terminated line at pos and move pos after it.
+     * return NEED_MORE if the line is incomplete, BAD if it is malformed or too long
+     */
+    static ParseResult ReadLine(const char *&pos, const char *end, std::string_view &line)
     {
-        if (request.content_length == 0)
+        std::size_t lf = FindFirstOf(pos, end - pos, LF_SET);
+        if (pos + lf == end)
         {
-            return std::make_tuple(ParseResult::GOOD, 0);
+            return (lf > MAX_CHUNK_LINE) ? ParseResult::BAD : ParseResult::NEED_MORE;
         }
+        if (lf == 0 || pos[lf - 1] != '\r')
+        {
+            return ParseResult::BAD;
+        }
+
+        line = std::string_view(pos, lf - 1);
+        pos += lf + 1;
+        return ParseResult::GOOD;
+    }
 
-        std::size_t remain_len = request.content_length - request.body.size();
-        if (remain_len <= size)
+    // find the CRLF ends the line in [data, end), return the CR position or nullptr
+    static const char* FindLineEnd(const char *data, const char *end)
+    {
+        std::size_t pos = FindFirstOf(data, end - data, LF_SET);
+        if (pos == 0 || data + pos == end || data[pos - 1] != '\r')
         {
-            request.body.append(data, remain_len);
-            return std::make_tuple(ParseResult::GOOD, remain_len);
+            return nullptr;
         }
-        else
+        return data + pos - 1;
+    }
+
+    // parse request line and headers in [data, data + header_size_)
+    bool ParseHeaderBlock(Request &request, const char *data)
+    {
+        request.Clear();
+
+        // end of the last header line, exclude the empty line
+        const char *end = data + header_size_ - CRLF.size();
+        const char *line_end = FindLineEnd(data, end);
+        if (line_end == nullptr ||
+            !ParseRequestLine(request, std::string_view(data, line_end - data)))
+        {
+            return false;
+        }
+
+        const char *line = line_end + CRLF.size();
+        while (line < end)
         {
-            request.body.append(data, size);
-            return std::make_tuple(ParseResult::NEED_MORE, size);
+            // field-name ":" field-value CRLF
+            std::size_t pos = FindFirstOf(line, end - line, COLON_LF_SET);
+            if (line + pos == end || line[pos] != ':')
+            {
+                return false;
+            }
+            const char *value = line + pos + 1;
+            line_end = FindLineEnd(value, end);
+            if (line_end == nullptr)
+            {
+                return false;
+            }
+
+            request.headers.push_back(HeaderView{Trim(std::string_view(line, pos)),
+                                                 Trim(std::string_view(value, line_end - value))});
+            line = line_end + CRLF.size();
         }
+
+        return GetBodyLength(request);
     }
 
-    std::size_t GetBodyLength(const Request &request)
+    bool ParseRequestLine(Request &request, std::string_view request_line)
     {
-        auto content_length_header = ifind_header(request.headers, "Content-Length");
-        if (!content_length_header)
+        //Request-Line = Method SP Request-URI SP HTTP-Version CRLF
+
+        // method
+        std::size_t pos = FindFirstOf(request_line.data(), request_line.size(), SP_SET);
+        if (pos == request_line.size())
         {
-            return 0;
+            return false;
         }
+        request.method = request_line.substr(0, pos);
+        request_line.remove_prefix(pos + 1);
+        // TODO: check method
 
-        int body_len = 0;
-        try
+        // uri
+        pos = FindFirstOf(request_line.data(), request_line.size(), SP_SET);
+        if (pos == request_line.size())
         {
-            body_len = std::stoi(content_length_header->value);
+            return false;
         }
-        catch (const std::exception &e)
+        request.uri = request_line.substr(0, pos);
+        request_line.remove_prefix(pos + 1);
+
+        // version
+        if (request_line.find("HTTP/") == std::string_view::npos)
         {
-            LOG_ERROR("invalid content-length %s, %s",
-                content_length_header->value.c_str(), e.what());
-            // throw exception
+            return false;
         }
-        return body_len;
+        request.version = request_line;
+
+        return true;
+    }
+
+    bool GetBodyLength(Request &request)
+    {
+        // Transfer-Encoding overrides Content-Length, only chunked is supported
+        auto transfer_encoding = request.GetHeader(TRANSFER_ENCODING);
+        if (transfer_encoding)
+        {
+            if (!boost::iends_with(*transfer_encoding, CHUNKED))
+            {
+                LOG_ERROR("unsupported transfer-encoding %s", *transfer_encoding);
+                return false;
+            }
+            chunked_ = true;
+            request.content_length = 0;
+            return true;
+        }
+
+        auto content_length = request.GetHeader(CONTENT_LENGTH);
+        if (!content_length)
+        {
+            request.content_length = 0;
+            return true;
+        }
+
+        const char *first = content_length->data();
+        const char *last = first + content_length->size();
+        auto [ptr, ec] = std::from_chars(first, last, request.content_length);
+        if (ec != std::errc() || ptr != last)
+        {
+            LOG_ERROR("invalid content-length %s", *content_length);
+            return false;
+        }
+        return true;
+    }
+
+    template<typename Integer>
+    static void AppendNumber(std::string &str, Integer value)
+    {
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        str.append(buffer, result.ptr);
+    }
+
+    // case insensitive find token in a comma separated header value
+    static bool HasToken(std::string_view value, std::string_view token)
+    {
+        while (!value.empty())
+        {
+            std::size_t pos = value.find(',');
+            std::string_view item = Trim(value.substr(0, pos));
+            if (item.size() == token.size() && boost::iequals(item, token))
+            {
+                return true;
+            }
+            if (pos == std::string_view::npos)
+            {
+                break;
+            }
+            value.remove_prefix(pos + 1);
+        }
+        return false;
+    }
+
+    static std::string_view Trim(std::string_view str)
+    {
+        static const char *whitespace = " \t";
+        std::string_view::size_type pos = str.find_first_not_of(whitespace);
+        if (pos == std::string_view::npos)
+        {
+            return std::string_view();
+        }
+        str.remove_prefix(pos);
+        str.remove_suffix(str.size() - str.find_last_not_of(whitespace) - 1);
+        return str;
     }
 
     void Reset()
     {
-        parse_status_ = ParseStatus::REQUEST_LINE;
+        parse_status_ = ParseStatus::HEADERS;
+        scanned_size_ = 0;
+        header_size_ = 0;
+        header_base_ = nullptr;
+        body_remain_ = 0;
+        chunked_ = false;
+        stream_chunks_ = false;
+        chunk_remain_ = 0;
     }
 
     enum class ParseStatus
     {
-        REQUEST_LINE,
         HEADERS,
-        BODY
+        BODY,
+        BODY_STREAM,
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_DATA_END,
+        CHUNK_TRAILER
     } parse_status_;
+
+    static constexpr std::size_t CHUNK_SIZE_WIDTH = 2 * sizeof(std::size_t); // hex digits of chunk-size
+    static constexpr std::size_t MAX_CHUNK_LINE = 4096; // max chunk-size or trailer line
+
+
+    std::size_t scanned_size_ = 0; // data already scanned for the end of header block
+    std::size_t header_size_ = 0; // request line and headers size, include the empty line
+    const char *header_base_ = nullptr; // data address when the header block was parsed
+    std::string header_storage_; // copy of the header block while the body streams
+    std::size_t body_remain_ = 0; // body bytes not streamed yet
+    bool chunked_ = false; // request body has chunked transfer coding
+    bool stream_chunks_ = false; // decoded chunks go to handler.on_body
+    std::size_t chunk_remain_ = 0; // data bytes not parsed of the current chunk
+    std::string body_storage_; // decoded chunked body which is not streamed
+    bool headers_too_large_ = false; // the last TOO_LARGE was for the header block
 };
 
 } // namespace http
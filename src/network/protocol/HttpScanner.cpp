@@ -0,0 +1,105 @@
+#include "HttpScanner.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCANNER_X86
+#endif
+
+namespace network {
+namespace protocol {
+namespace http {
+
+using ScanFunction = std::size_t (*)(const char *, std::size_t, const DelimiterSet &);
+
+static std::size_t ScanScalar(const char *data, std::size_t size, const DelimiterSet &delimiters)
+{
+    const char *chars = delimiters.data();
+    for (std::size_t i = 0; i < size; i++)
+    {
+        char c = data[i];
+        if (c == chars[0] || c == chars[1] || c == chars[2] || c == chars[3])
+        {
+            return i;
+        }
+    }
+    return size;
+}
+
+#ifdef HTTP_SCANNER_X86
+
+__attribute__((target("sse4.2")))
+static std::size_t ScanSse42(const char *data, std::size_t size, const DelimiterSet &delimiters)
+{
+    const __m128i needle = _mm_load_si128(reinterpret_cast<const __m128i *>(delimiters.data()));
+    const int needle_size = static_cast<int>(delimiters.size());
+
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i haystack = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        int index = _mm_cmpestri(needle, needle_size, haystack, 16,
+                                 _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (index != 16)
+        {
+            return i + index;
+        }
+    }
+
+    // never read past the end of data
+    return i + ScanScalar(data + i, size - i, delimiters);
+}
+
+__attribute__((target("avx2")))
+static std::size_t ScanAvx2(const char *data, std::size_t size, const DelimiterSet &delimiters)
+{
+    const char *chars = delimiters.data();
+    const __m256i c0 = _mm256_set1_epi8(chars[0]);
+    const __m256i c1 = _mm256_set1_epi8(chars[1]);
+    const __m256i c2 = _mm256_set1_epi8(chars[2]);
+    const __m256i c3 = _mm256_set1_epi8(chars[3]);
+
+    std::size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i haystack = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        __m256i match = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(haystack, c0), _mm256_cmpeq_epi8(haystack, c1)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(haystack, c2), _mm256_cmpeq_epi8(haystack, c3)));
+        unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(match));
+        if (mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + ScanScalar(data + i, size - i, delimiters);
+}
+
+#endif // HTTP_SCANNER_X86
+
+static ScanFunction SelectScanFunction()
+{
+#ifdef HTTP_SCANNER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return ScanAvx2;
+    }
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        return ScanSse42;
+    }
+#endif
+    return ScanScalar;
+}
+
+static const ScanFunction scan_function = SelectScanFunction();
+
+std::size_t FindFirstOf(const char *data, std::size_t size, const DelimiterSet &delimiters)
+{
+    return scan_function(data, size, delimiters);
+}
+
+} // namespace http
+} // namespace protocol
+} // namespace network
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace network {
+namespace protocol {
+namespace http {
+
+/**
+ * set of at most 4 delimiter chars searched by FindFirstOf
+ */
+class DelimiterSet
+{
+public:
+    static constexpr std::size_t max_size = 4;
+
+    constexpr explicit DelimiterSet(std::string_view chars)
+      : chars_{}, size_(chars.size() < max_size ? chars.size() : max_size)
+    {
+        // unused slots repeat the first char, so vector kernels can always compare all 4
+        for (std::size_t i = 0; i < max_size; i++)
+        {
+            chars_[i] = chars[i < size_ ? i : 0];
+        }
+    }
+
+    const char* data() const {return chars_;}
+    std::size_t size() const {return size_;}
+
+private:
+    alignas(16) char chars_[16];
+    std::size_t size_;
+};
+
+static constexpr DelimiterSet LF_SET("\n");
+static constexpr DelimiterSet SP_SET(" ");
+static constexpr DelimiterSet COLON_LF_SET(":\n");
+
+/**
+ * find the first char of data in delimiters, return size if not found.
+ * uses AVX2 or SSE4.2 when the cpu supports it, chosen once at startup
+ */
+std::size_t FindFirstOf(const char *data, std::size_t size, const DelimiterSet &delimiters);
+
+} // namespace http
+} // namespace protocol
+} // namespace network
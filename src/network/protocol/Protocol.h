@@ -1,31 +1,140 @@
 #pragma once
 
 #include <tuple>
+#include <string>
+#include <functional>
+#include <cstdint>
 #include <boost/asio.hpp>
 
 namespace network {
 namespace protocol {
 
+/**
+ * state of a streamed body after its producer was called
+ */
+enum class BodyState {
+    MORE,     // data was produced and more follows. MORE without data is treated as PENDING
+    PENDING,  // no data now, the producer calls its resumer once there is more
+    DONE      // the last part was produced
+};
+
+/**
+ * continues a connection that waits for a handler: a pending streamed response body
+ * has more data, or a streamed request body chunk is processed.
+ * it can be called from any thread, it is a no-op if the connection is closed already
+ */
+using Resumer = std::function<void()>;
+
+/**
+ * makes the resumer for a streamed request body chunk, see Protocol::Parse
+ */
+using ResumerFactory = std::function<Resumer()>;
+
 template<typename Request, typename Response, typename Handler>
 class Protocol {
 public:
     using RequestType = Request;
     using ResponseType = Response;
     using HandlerType = Handler;
+    using BodyState = protocol::BodyState;
+    using Resumer = protocol::Resumer;
+    using ResumerFactory = protocol::ResumerFactory;
 
     enum class ParseResult {
         GOOD,
         BAD,
-        NEED_MORE
+        NEED_MORE,
+        TOO_LARGE,
+        PAUSED     // a streamed body chunk is with the handler, parse again after it resumes
     };
 
+    /**
+     * whether the connection stays open after the response to a request
+     */
+    enum class KeepAlive {
+        DEFAULT,   // stay open, it is the default of the protocol version
+        ANNOUNCE,  // stay open, the response must say so
+        CLOSE      // close after the response, the response must say so
+    };
+
+    /**
+     * parse a request from data, return GOOD and the bytes used by the whole request.
+     * request may point into data, caller must keep data until request is handled.
+     * a body streamed to handler is consumed while it arrives,
+     * NEED_MORE may return the bytes of the handled chunks.
+     * PAUSED returns the bytes up to the end of a chunk given to handler with a resumer
+     * of make_resumer, the caller keeps them and calls Parse again after the resumer ran
+     */
     virtual std::tuple<ParseResult, std::size_t>
-    Parse(RequestType &request, const char *data, std::size_t size) = 0;
+    Parse(RequestType &request, HandlerType &handler, const ResumerFactory &make_resumer,
+          const char *data, std::size_t size) = 0;
+
+    /**
+     * append what the access log shows of request, like its method and target. never the body
+     */
+    virtual void DescribeRequest(const RequestType &request, std::string &out) const = 0;
+
+    /**
+     * status code of response for the access log
+     */
+    virtual int GetStatus(const ResponseType &response) const = 0;
 
-    virtual void Serialize(const Response &response, boost::asio::streambuf &streambuf) = 0;
+    /**
+     * what the client asked for in request
+     */
+    virtual KeepAlive GetKeepAlive(const RequestType &request) const = 0;
+
+    /**
+     * protocol version of request as the protocol numbers it, passed back to
+     * Serialize and SerializeChunk for the response
+     */
+    virtual int GetVersion(const RequestType &request) const = 0;
+
+    /**
+     * true if the headers of a request are parsed and its body is being received
+     */
+    virtual bool IsReadingBody() const = 0;
+
+    /**
+     * response for a request the parser rejected with BAD or TOO_LARGE
+     */
+    virtual void MakeErrorResponse(ParseResult result, ResponseType &response) = 0;
+
+    /**
+     * append the response framing to head, return the body to send after head.
+     * body is not copied, response must be kept until it is written.
+     * keep_alive is set to CLOSE if only closing the connection can end the body
+     */
+    virtual boost::asio::const_buffer
+    Serialize(const ResponseType &response, KeepAlive &keep_alive, int version, std::string &head) = 0;
+
+    /**
+     * true if the response body is produced in pieces by SerializeChunk after Serialize
+     */
+    virtual bool IsStreamed(const ResponseType &response) = 0;
+
+    /**
+     * append the next framed piece of a streamed body to out and return the state of the body.
+     * a PENDING body is not serialized again until resume is called
+     */
+    virtual BodyState
+    SerializeChunk(ResponseType &response, int version, const Resumer &resume, std::string &out) = 0;
+
+    /**
+     * @param max_body_size bodies larger than it are rejected with TOO_LARGE
+     * @param max_buffered_size max size of a request whose body is not streamed
+     */
+    void SetLimits(std::size_t max_body_size, std::size_t max_buffered_size)
+    {
+        max_body_size_ = max_body_size;
+        max_buffered_size_ = max_buffered_size;
+    }
 
 protected:
     virtual ~Protocol(){}
+
+    std::size_t max_body_size_ = SIZE_MAX;
+    std::size_t max_buffered_size_ = SIZE_MAX;
 };
 
 } // namespace protocol
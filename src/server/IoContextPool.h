@@ -5,8 +5,19 @@
 #include <thread>
 #include <memory>
 #include <stdexcept>
+#include <atomic>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
 #include <boost/asio.hpp>
 
+#include "log/log.h"
+
 namespace server {
 
 class IoContextPool
@@ -15,7 +26,28 @@ public:
     IoContextPool(const IoContextPool&) = delete;
     IoContextPool& operator=(const IoContextPool&) = delete;
 
-    explicit IoContextPool(std::size_t pool_size)
+    /**
+     * how GetIoContextIndex chooses an io_context
+     */
+    enum class Policy
+    {
+        ROUND_ROBIN,
+        LEAST_CONNECTIONS
+    };
+
+    /**
+     * memory policy of the io_context threads
+     */
+    enum class NumaPolicy
+    {
+        NONE,  // keep the policy of the process
+        LOCAL  // allocate on the numa node of the cpu the thread runs on. that is the kernel
+               // default, it undoes a policy the process was started with, like numactl --interleave
+    };
+
+    explicit IoContextPool(std::size_t pool_size, Policy policy = Policy::ROUND_ROBIN)
+      : policy_(policy),
+        connection_counts_(pool_size)
     {
         if (0 == pool_size)
         {
@@ -32,13 +64,72 @@ public:
 
     boost::asio::io_context& GetIoContext()
     {
-        static std::size_t index = 0;
-        if (index >= io_contexts_.size())
+        return GetIoContext(NextIndex());
+    }
+
+    /**
+     * index of the io_context for a new connection, chosen by policy
+     */
+    std::size_t GetIoContextIndex()
+    {
+        if (policy_ == Policy::ROUND_ROBIN)
         {
-            index = 0;
+            return NextIndex();
         }
 
-        return *io_contexts_[index++];
+        // least connections, ties are broken round robin
+        std::size_t size = io_contexts_.size();
+        std::size_t start = NextIndex();
+        std::size_t index = start;
+        std::size_t min_count = GetConnectionCount(start).load(std::memory_order_relaxed);
+        for (std::size_t i = 1; i < size && min_count > 0; i++)
+        {
+            std::size_t candidate = (start + i) % size;
+            std::size_t count = GetConnectionCount(candidate).load(std::memory_order_relaxed);
+            if (count < min_count)
+            {
+                min_count = count;
+                index = candidate;
+            }
+        }
+
+        return index;
+    }
+
+    /**
+     * connections running on the io_context of index, used by Policy::LEAST_CONNECTIONS.
+     * increased when a connection is placed on the io_context, decreased when it stops
+     */
+    std::atomic<std::size_t>& GetConnectionCount(std::size_t index)
+    {
+        return connection_counts_[index].count;
+    }
+
+    boost::asio::io_context& GetIoContext(std::size_t index)
+    {
+        return *io_contexts_[index];
+    }
+
+    std::size_t Size() const
+    {
+        return io_contexts_.size();
+    }
+
+    /**
+     * pin the thread of io_context i to cpus[i % cpus.size()], empty for no pinning.
+     * call it before Run
+     */
+    void SetCpuAffinity(const std::vector<int> &cpus)
+    {
+        cpus_ = cpus;
+    }
+
+    /**
+     * call it before Run
+     */
+    void SetNumaPolicy(NumaPolicy numa_policy)
+    {
+        numa_policy_ = numa_policy;
     }
 
     void Run()
@@ -48,6 +139,7 @@ public:
         {
             threads.emplace_back(std::thread(
                 [this, i](){
+                    SetupThread(i);
                     io_contexts_[i]->run();
                 }));
         }
@@ -67,6 +159,35 @@ public:
     }
 
 private:
+    void SetupThread(std::size_t index)
+    {
+        if (!cpus_.empty())
+        {
+            int cpu = cpus_[index % cpus_.size()];
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(cpu, &cpu_set);
+            int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+            if (err != 0)
+            {
+                LOG_WARN("pin io context %lu to cpu %d failed, %s", index, cpu, strerror(err));
+            }
+        }
+
+        // pages are taken from the node the thread runs on when they are first touched,
+        // so connection memory is created on this thread, see Server::StartConnection
+        if (numa_policy_ == NumaPolicy::LOCAL &&
+            syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0) != 0)
+        {
+            LOG_WARN("set local numa policy for io context %lu failed, %s", index, strerror(errno));
+        }
+    }
+
+    std::size_t NextIndex()
+    {
+        return next_index_.fetch_add(1, std::memory_order_relaxed) % io_contexts_.size();
+    }
+
     using IoContextPtr = std::shared_ptr<boost::asio::io_context>;
     using IoContextWork =  boost::asio::executor_work_guard<
                                 boost::asio::io_context::executor_type>;
@@ -76,6 +197,18 @@ private:
 
     /// The work that keeps the io_contexts running.
     std::vector<IoContextWork> work_;
+
+    Policy policy_;
+    NumaPolicy numa_policy_ = NumaPolicy::NONE;
+    std::vector<int> cpus_;
+    std::atomic<std::size_t> next_index_{0};
+
+    /// one cache line per counter, they are updated from different threads
+    struct alignas(64) ConnectionCount
+    {
+        std::atomic<std::size_t> count{0};
+    };
+    std::vector<ConnectionCount> connection_counts_;
     
 };
 
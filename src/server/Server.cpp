@@ -3,35 +3,160 @@
 #include <signal.h>
 
 #include <thread>
+#include <atomic>
 #include <sstream>
 
 #include "log/log.h"
+#include "config/config.h"
 
 namespace server {
 
+#ifdef SO_REUSEPORT
+using reuse_port = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+
 Server::Server(const std::string& address, const std::string &port)
-    : io_context_pool_(std::thread::hardware_concurrency()),
+    : io_context_pool_(GetThreadCount(config::Config::instance().getServerThreads()),
+                       GetIoContextPolicy(config::Config::instance().getServerIoContextPolicy())),
       signal_set_(io_context_pool_.GetIoContext()),
-      acceptor_(io_context_pool_.GetIoContext())
+      reuse_port_(config::Config::instance().getServerReusePort())
 {
+    connection_settings_.read_buffer_size = config::Config::instance().getServerReadBufferSize();
+    connection_settings_.read_buffer_high_water = config::Config::instance().getServerReadBufferHighWater();
+    connection_settings_.max_body_size = config::Config::instance().getServerMaxBodySize();
+    connection_settings_.max_pending_responses = config::Config::instance().getServerMaxPendingResponses();
+    connection_settings_.write_batch_bytes = config::Config::instance().getServerWriteBatchBytes();
+    connection_settings_.write_batch_buffers = config::Config::instance().getServerWriteBatchBuffers();
+    connection_settings_.header_timeout = std::chrono::seconds(config::Config::instance().getServerHeaderTimeout());
+    connection_settings_.body_timeout = std::chrono::seconds(config::Config::instance().getServerBodyTimeout());
+    connection_settings_.idle_timeout = std::chrono::seconds(config::Config::instance().getServerIdleTimeout());
+    connection_settings_.write_timeout = std::chrono::seconds(config::Config::instance().getServerWriteTimeout());
+    connection_settings_.linger_timeout = std::chrono::seconds(config::Config::instance().getServerLingerTimeout());
+    connection_settings_.max_requests_per_connection =
+        config::Config::instance().getServerMaxRequestsPerConnection();
+    connection_settings_.access_log_sample = config::Config::instance().getServerAccessLogSample();
+    connection_settings_.access_log_rate_limit = config::Config::instance().getServerAccessLogRateLimit();
+
+    worker_pool_ = std::make_unique<util::WorkerPool>(
+        GetThreadCount(config::Config::instance().getServerWorkerThreads()),
+        config::Config::instance().getServerWorkerQueueSize(),
+        GetWorkerScheduler(config::Config::instance().getServerWorkerScheduler()));
+    LOG_INFO("worker pool %lu threads", worker_pool_->Size());
+
+    for (std::size_t i = 0; i < io_context_pool_.Size(); i++)
+    {
+        connection_managers_.push_back(std::make_unique<ConnectionManagerType>(
+            io_context_pool_.GetIoContext(i), io_context_pool_.GetConnectionCount(i),
+            connection_settings_, worker_pool_.get()));
+        connection_pools_.push_back(
+            std::make_shared<network::ConnectionPool>(connection_settings_.read_buffer_size));
+    }
+
+    io_context_pool_.SetCpuAffinity(config::Config::instance().getServerCpus());
+    io_context_pool_.SetNumaPolicy(GetNumaPolicy(config::Config::instance().getServerNumaPolicy()));
+
+#ifndef SO_REUSEPORT
+    if (reuse_port_)
+    {
+        LOG_WARN("SO_REUSEPORT is not supported, use one acceptor");
+        reuse_port_ = false;
+    }
+#endif
+
     RegisterSignalHandler();
 
     boost::asio::ip::tcp::resolver resolver(io_context_pool_.GetIoContext());
     boost::asio::ip::tcp::endpoint endpoint =
         *resolver.resolve(address, port).begin();
-    acceptor_.open(endpoint.protocol());
-    acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
-    acceptor_.bind(endpoint);
-    acceptor_.listen();
-    LOG_INFO("listen on %s:%s", address.c_str(), port.c_str());
 
-    Accept();
+    // with reuse_port each io_context listens on its own socket and the kernel
+    // spreads new connections over them, otherwise one acceptor hands them out
+    std::size_t acceptor_count = reuse_port_ ? io_context_pool_.Size() : 1;
+    for (std::size_t i = 0; i < acceptor_count; i++)
+    {
+        boost::asio::io_context &io_context =
+            reuse_port_ ? io_context_pool_.GetIoContext(i) : io_context_pool_.GetIoContext();
+        acceptors_.emplace_back(io_context);
+        boost::asio::ip::tcp::acceptor &acceptor = acceptors_.back();
+        acceptor.open(endpoint.protocol());
+        acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+        if (reuse_port_)
+        {
+            acceptor.set_option(reuse_port(true));
+        }
+#endif
+        acceptor.bind(endpoint);
+        acceptor.listen();
+    }
+    LOG_INFO("listen on %s:%s, %lu acceptor", address.c_str(), port.c_str(), acceptors_.size());
+
+    for (std::size_t i = 0; i < acceptors_.size(); i++)
+    {
+        Accept(i);
+    }
+}
+
+std::size_t Server::GetThreadCount(std::size_t threads)
+{
+    if (threads == 0)
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+    return threads;
+}
+
+IoContextPool::NumaPolicy Server::GetNumaPolicy(const std::string &policy)
+{
+    if (policy == "local")
+    {
+        return IoContextPool::NumaPolicy::LOCAL;
+    }
+    else if (policy != "none")
+    {
+        LOG_WARN("unknown numa policy %s, use none", policy.c_str());
+    }
+    return IoContextPool::NumaPolicy::NONE;
+}
+
+util::WorkerPool::Scheduler Server::GetWorkerScheduler(const std::string &scheduler)
+{
+    if (scheduler == "work_stealing")
+    {
+        return util::WorkerPool::Scheduler::WORK_STEALING;
+    }
+    else if (scheduler != "shared_queue")
+    {
+        LOG_WARN("unknown worker scheduler %s, use shared_queue", scheduler.c_str());
+    }
+    return util::WorkerPool::Scheduler::SHARED_QUEUE;
+}
+
+IoContextPool::Policy Server::GetIoContextPolicy(const std::string &policy)
+{
+    if (policy == "least_connections")
+    {
+        return IoContextPool::Policy::LEAST_CONNECTIONS;
+    }
+    else if (policy != "round_robin")
+    {
+        LOG_WARN("unknown io context policy %s, use round_robin", policy.c_str());
+    }
+    return IoContextPool::Policy::ROUND_ROBIN;
 }
 
 void Server::Run()
 {
     LOG_INFO("run io context pool");
     io_context_pool_.Run();
+    worker_pool_->Stop();
+
+    for (std::size_t i = 0; i < connection_pools_.size(); i++)
+    {
+        network::ConnectionPool::Stats stats = connection_pools_[i]->GetStats();
+        LOG_INFO("connection pool %lu: connection hit %lu miss %lu, buffer hit %lu miss %lu", i,
+            stats.block_hits, stats.block_misses, stats.buffer_hits, stats.buffer_misses);
+    }
 }
 
 void Server::RegisterSignalHandler()
@@ -45,22 +170,37 @@ void Server::RegisterSignalHandler()
             // The server is stopped by cancelling all outstanding asynchronous
             // operations. Once all operations have finished the io_context::run()
             // call will exit.
-            acceptor_.close();
-            LOG_INFO("stop accept");
-            io_context_pool_.Stop();
-            LOG_INFO("stop io context pool");
+            // an acceptor is only used on the thread of its io_context, with reuse_port
+            // that is another thread, so each is closed there and the last one stops the pool
+            auto pending = std::make_shared<std::atomic<std::size_t>>(acceptors_.size());
+            for (auto &acceptor : acceptors_)
+            {
+                boost::asio::post(acceptor.get_executor(),
+                    [this, &acceptor, pending]()
+                    {
+                        acceptor.close();
+                        if (pending->fetch_sub(1, std::memory_order_acq_rel) == 1)
+                        {
+                            LOG_INFO("stop accept");
+                            io_context_pool_.Stop();
+                            LOG_INFO("stop io context pool");
+                        }
+                    });
+            }
         }
     );
 }
 
-void Server::Accept()
+void Server::Accept(std::size_t acceptor_index)
 {
-    acceptor_.async_accept(io_context_pool_.GetIoContext(),
-        [this](boost::system::error_code ec, boost::asio::ip::tcp::socket socket)
+    // an acceptor of reuse_port keeps connections on its own io_context
+    std::size_t index = reuse_port_ ? acceptor_index : io_context_pool_.GetIoContextIndex();
+    acceptors_[acceptor_index].async_accept(io_context_pool_.GetIoContext(index),
+        [this, acceptor_index, index](boost::system::error_code ec, boost::asio::ip::tcp::socket socket)
         {
             // Check whether the server was stopped by a signal before this
             // completion handler had a chance to run.
-            if (!acceptor_.is_open())
+            if (!acceptors_[acceptor_index].is_open())
             {
                 return;
             }
@@ -70,17 +210,38 @@ void Server::Accept()
                 std::ostringstream ss;
                 ss << socket.remote_endpoint();
                 LOG_INFO("accept connection %s", ss.str().c_str());
-                auto connection = std::make_shared<network::Connection<ProtocolType>>(std::move(socket), connection_manager_);
-                connection_manager_.Start(connection);
+                StartConnection(index, std::move(socket));
             }
             else
             {
                 LOG_ERROR("accept error, %s", ec.message().c_str());
             }
 
-            Accept();
+            Accept(acceptor_index);
         }
     );
 }
 
+void Server::StartConnection(std::size_t index, boost::asio::ip::tcp::socket socket)
+{
+    // count it now, so the next accept already sees the load
+    io_context_pool_.GetConnectionCount(index).fetch_add(1, std::memory_order_relaxed);
+
+    // the connection is created on the thread of its io_context, so its memory and buffer
+    // are first touched on the numa node of that thread, and the manager is only used there.
+    // runs inline when the connection was accepted on that thread
+    boost::asio::any_io_executor executor = socket.get_executor();
+    boost::asio::dispatch(executor,
+        [this, index, socket = std::move(socket)]() mutable
+        {
+            // connection memory and buffers are reused from the pool of its io_context
+            const auto &pool = connection_pools_[index];
+            ConnectionManagerType &manager = *connection_managers_[index];
+            auto connection = std::allocate_shared<ConnectionType>(
+                network::PoolAllocator<ConnectionType>(pool),
+                std::move(socket), manager, pool);
+            manager.Start(connection);
+        });
+}
+
 } // namespace server
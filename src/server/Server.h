@@ -1,13 +1,18 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <memory>
 
 #include <boost/asio.hpp>
 
 #include "IoContextPool.h"
 #include "network/ConnectionManager.h"
+#include "network/ConnectionPool.h"
+#include "network/ConnectionSettings.h"
 #include "network/Connection.h"
 #include "network/protocol/Http.h"
+#include "utils/WorkerPool.h"
 
 namespace server {
 
@@ -21,14 +26,28 @@ public:
     void Run();
 
 private:
+    static std::size_t GetThreadCount(std::size_t threads);
+    static IoContextPool::Policy GetIoContextPolicy(const std::string &policy);
+    static IoContextPool::NumaPolicy GetNumaPolicy(const std::string &policy);
+    static util::WorkerPool::Scheduler GetWorkerScheduler(const std::string &scheduler);
     void RegisterSignalHandler();
-    void Accept();
+    void Accept(std::size_t acceptor_index);
+    void StartConnection(std::size_t index, boost::asio::ip::tcp::socket socket);
 
     IoContextPool io_context_pool_;
+    /// runs cpu bound requests, stopped before io_context_pool_ is destroyed
+    std::unique_ptr<util::WorkerPool> worker_pool_;
     boost::asio::signal_set signal_set_;
-    boost::asio::ip::tcp::acceptor acceptor_;
+    /// one acceptor, or one for each io_context when reuse_port_
+    std::vector<boost::asio::ip::tcp::acceptor> acceptors_;
+    bool reuse_port_;
     using ProtocolType = network::protocol::http::Http;
-    network::ConnectionManager<network::Connection<ProtocolType>> connection_manager_;
+    using ConnectionType = network::Connection<ProtocolType>;
+    using ConnectionManagerType = network::ConnectionManager<ConnectionType>;
+    network::ConnectionSettings connection_settings_;
+    /// one manager and pool for each io_context, indexed as io_context_pool_
+    std::vector<std::unique_ptr<ConnectionManagerType>> connection_managers_;
+    std::vector<std::shared_ptr<network::ConnectionPool>> connection_pools_;
 };
 
 } // namespace server
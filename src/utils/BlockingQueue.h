@@ -5,6 +5,8 @@
 #include <mutex>
 #include <condition_variable>
 #include <stdexcept>
+#include <chrono>
+#include <algorithm>
 
 namespace util{
 
@@ -22,12 +24,23 @@ public:
     }
 };
 
+/**
+ * queue for producer and consumer threads.
+ * an optional capacity gives producers back-pressure, push waits and try_push fails
+ * when the queue is full. after interrupt, pop calls throw interrupt_error and try_ calls
+ * fail. push only waits and throws when a bounded queue is full, otherwise it adds the
+ * element even after interrupt, so push to an unbounded queue never throws
+ */
 template<typename T>
 class BlockingQueue final
 {
 public:
-    BlockingQueue()
-        : mInterrupt(false)
+    /**
+     * @param capacity max elements, 0 for unbounded
+     */
+    explicit BlockingQueue(size_t capacity = 0)
+        : mCapacity(capacity),
+          mInterrupt(false)
     {
     }
     ~BlockingQueue() = default;
@@ -38,39 +51,139 @@ public:
 
     void push(const T &val)
     {
+        std::unique_lock<std::mutex> lock(mMutex);
+        WaitNotFull(lock);
+        mQueue.emplace(val);
+        NotifyConsumer(lock, 1);
+    }
+
+    void push(T &&val)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        WaitNotFull(lock);
+        mQueue.emplace(std::move(val));
+        NotifyConsumer(lock, 1);
+    }
+
+    /**
+     * return false if the queue is full or interrupted
+     */
+    bool try_push(T &&val)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mInterrupt || Full())
         {
-            std::lock_guard<std::mutex> lock(mMutex);
-            mQueue.emplace(val);
+            return false;
         }
+        mQueue.emplace(std::move(val));
+        NotifyConsumer(lock, 1);
+        return true;
+    }
 
-        mCondition.notify_one();
+    bool try_push(const T &val)
+    {
+        T copy(val);
+        return try_push(std::move(copy));
     }
 
-    void push(T &&val)
+    /**
+     * push [first, last) with one lock, or one lock for each part that fits a bounded queue
+     */
+    template<typename InputIterator>
+    void push_bulk(InputIterator first, InputIterator last)
     {
+        std::unique_lock<std::mutex> lock(mMutex, std::defer_lock);
+        while (first != last)
         {
-            std::lock_guard<std::mutex> lock(mMutex);
-            mQueue.emplace(std::move(val));
+            lock.lock();
+            WaitNotFull(lock);
+            size_t count = 0;
+            while (first != last && !Full())
+            {
+                mQueue.emplace(*first);
+                ++first;
+                count++;
+            }
+            NotifyConsumer(lock, count);
         }
-
-        mCondition.notify_one();
     }
 
     T pop()
     {
         std::unique_lock<std::mutex> lock(mMutex);
-        mCondition.wait(lock, [this](){
+        WaitNotEmpty(lock);
+
+        T val(std::move(mQueue.front()));
+        mQueue.pop();
+        NotifyProducer(lock, 1);
+        return val;
+    }
+
+    /**
+     * return false if the queue is empty or interrupted
+     */
+    bool try_pop(T &val)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mInterrupt || mQueue.empty())
+        {
+            return false;
+        }
+
+        val = std::move(mQueue.front());
+        mQueue.pop();
+        NotifyProducer(lock, 1);
+        return true;
+    }
+
+    /**
+     * return false if no element arrived in timeout
+     */
+    template<typename Rep, typename Period>
+    bool pop_for(T &val, const std::chrono::duration<Rep, Period> &timeout)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mPopWaiters++;
+        bool ready = mCondition.wait_for(lock, timeout, [this](){
             return (mInterrupt || !mQueue.empty());
         });
+        mPopWaiters--;
 
         if (mInterrupt)
         {
             throw interrupt_error("interrupted");
         }
+        if (!ready)
+        {
+            return false;
+        }
 
-        T val(std::move(mQueue.front()));
+        val = std::move(mQueue.front());
         mQueue.pop();
-        return val;
+        NotifyProducer(lock, 1);
+        return true;
+    }
+
+    /**
+     * wait until the queue is not empty and pop up to max_count elements with one lock,
+     * return the number of elements written to out
+     */
+    template<typename OutputIterator>
+    size_t pop_bulk(OutputIterator out, size_t max_count)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        WaitNotEmpty(lock);
+
+        size_t count = 0;
+        while (count < max_count && !mQueue.empty())
+        {
+            *out = std::move(mQueue.front());
+            ++out;
+            mQueue.pop();
+            count++;
+        }
+        NotifyProducer(lock, count);
+        return count;
     }
 
     size_t size() const
@@ -79,6 +192,14 @@ public:
         return mQueue.size();
     }
 
+    /**
+     * 0 for unbounded
+     */
+    size_t capacity() const
+    {
+        return mCapacity;
+    }
+
     void interrupt()
     {
         {
@@ -86,12 +207,82 @@ public:
             mInterrupt = true;
         }
         mCondition.notify_all();
+        mNotFullCondition.notify_all();
     }
 
 private:
+    bool Full() const
+    {
+        return (mCapacity != 0 && mQueue.size() >= mCapacity);
+    }
+
+    void WaitNotEmpty(std::unique_lock<std::mutex> &lock)
+    {
+        mPopWaiters++;
+        mCondition.wait(lock, [this](){
+            return (mInterrupt || !mQueue.empty());
+        });
+        mPopWaiters--;
+
+        if (mInterrupt)
+        {
+            throw interrupt_error("interrupted");
+        }
+    }
+
+    void WaitNotFull(std::unique_lock<std::mutex> &lock)
+    {
+        if (!Full())
+        {
+            return;
+        }
+
+        mPushWaiters++;
+        mNotFullCondition.wait(lock, [this](){
+            return (mInterrupt || !Full());
+        });
+        mPushWaiters--;
+
+        if (mInterrupt)
+        {
+            throw interrupt_error("interrupted");
+        }
+    }
+
+    // unlock and only wake threads that are waiting, no more than the elements can serve
+    void NotifyConsumer(std::unique_lock<std::mutex> &lock, size_t count)
+    {
+        size_t waiters = mPopWaiters;
+        lock.unlock();
+        Notify(mCondition, std::min(count, waiters));
+    }
+
+    void NotifyProducer(std::unique_lock<std::mutex> &lock, size_t count)
+    {
+        size_t waiters = mPushWaiters;
+        lock.unlock();
+        Notify(mNotFullCondition, std::min(count, waiters));
+    }
+
+    static void Notify(std::condition_variable &condition, size_t count)
+    {
+        if (count == 1)
+        {
+            condition.notify_one();
+        }
+        else if (count > 1)
+        {
+            condition.notify_all();
+        }
+    }
+
     std::queue<T> mQueue;
+    const size_t mCapacity;
     mutable std::mutex mMutex;
-    std::condition_variable mCondition;
+    std::condition_variable mCondition; // not empty
+    std::condition_variable mNotFullCondition;
+    size_t mPopWaiters = 0;
+    size_t mPushWaiters = 0;
     bool mInterrupt;
 };
 
@@ -0,0 +1,257 @@
+#ifndef _MPMC_QUEUE_H_
+#define _MPMC_QUEUE_H_
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+
+#include "BlockingQueue.h"
+
+namespace util{
+
+/**
+ * bounded multi-producer multi-consumer queue on a lock-free ring.
+ * every cell has a sequence number telling whether it is free for the producer
+ * or filled for the consumer of a position, so producers and consumers only
+ * contend on one atomic each and never take a lock.
+ * the mutex is only used to park consumers when the queue is empty
+ */
+template<typename T>
+class MpmcQueue final
+{
+public:
+    /**
+     * @param capacity rounded up to a power of two
+     */
+    explicit MpmcQueue(size_t capacity)
+        : mCapacity(RoundUpPowerOfTwo(capacity)),
+          mMask(mCapacity - 1),
+          mCells(new Cell[mCapacity]),
+          mInterrupt(false)
+    {
+        for (size_t i = 0; i < mCapacity; i++)
+        {
+            mCells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    ~MpmcQueue() = default;
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+    MpmcQueue(MpmcQueue&&) = delete;
+    MpmcQueue& operator=(MpmcQueue&&) = delete;
+
+    /**
+     * return false if the queue is full, val is not moved then
+     */
+    bool try_push(T &&val)
+    {
+        uint64_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+        Cell *cell = nullptr;
+        while (true)
+        {
+            cell = &mCells[pos & mMask];
+            uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+            int64_t diff = static_cast<int64_t>(sequence - pos);
+            if (diff == 0)
+            {
+                if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // the consumer of the last round has not taken the cell
+                return false;
+            }
+            else
+            {
+                pos = mEnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->data = std::move(val);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        WakeConsumer();
+        return true;
+    }
+
+    bool try_push(const T &val)
+    {
+        T copy(val);
+        return try_push(std::move(copy));
+    }
+
+    bool try_pop(T &val)
+    {
+        return try_pop_bulk(&val, 1) == 1;
+    }
+
+    /**
+     * pop up to max_count contiguous ready elements with one claim, return the number popped
+     */
+    size_t try_pop_bulk(T *out, size_t max_count)
+    {
+        uint64_t pos = mDequeuePos.load(std::memory_order_relaxed);
+        size_t count = 0;
+        while (true)
+        {
+            // count the filled cells from pos
+            count = 0;
+            while (count < max_count)
+            {
+                uint64_t sequence = mCells[(pos + count) & mMask].sequence.load(std::memory_order_acquire);
+                if (sequence != pos + count + 1)
+                {
+                    break;
+                }
+                count++;
+            }
+
+            if (count == 0)
+            {
+                uint64_t sequence = mCells[pos & mMask].sequence.load(std::memory_order_acquire);
+                if (static_cast<int64_t>(sequence - (pos + 1)) < 0)
+                {
+                    // empty
+                    return 0;
+                }
+                // another consumer took pos
+                pos = mDequeuePos.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            if (mDequeuePos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            Cell &cell = mCells[(pos + i) & mMask];
+            out[i] = std::move(cell.data);
+            cell.sequence.store(pos + i + mCapacity, std::memory_order_release);
+        }
+        return count;
+    }
+
+    T pop()
+    {
+        T val;
+        pop_bulk(&val, 1);
+        return val;
+    }
+
+    /**
+     * wait until at least one element is ready and pop up to max_count of them.
+     * throw interrupt_error after interrupt
+     */
+    size_t pop_bulk(T *out, size_t max_count)
+    {
+        for (int i = 0; i < kSpinCount; i++)
+        {
+            if (mInterrupt.load(std::memory_order_relaxed))
+            {
+                throw interrupt_error("interrupted");
+            }
+
+            size_t count = try_pop_bulk(out, max_count);
+            if (count > 0)
+            {
+                return count;
+            }
+        }
+
+        size_t count = 0;
+        std::unique_lock<std::mutex> lock(mMutex);
+        // announce the waiter before checking the queue again, see WakeConsumer
+        mWaiters.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        mCondition.wait(lock, [&](){
+            return (mInterrupt.load(std::memory_order_relaxed) ||
+                    (count = try_pop_bulk(out, max_count)) > 0);
+        });
+        mWaiters.fetch_sub(1, std::memory_order_relaxed);
+
+        if (count == 0)
+        {
+            throw interrupt_error("interrupted");
+        }
+        return count;
+    }
+
+    size_t size() const
+    {
+        uint64_t enqueue_pos = mEnqueuePos.load(std::memory_order_relaxed);
+        uint64_t dequeue_pos = mDequeuePos.load(std::memory_order_relaxed);
+        return (enqueue_pos > dequeue_pos) ? enqueue_pos - dequeue_pos : 0;
+    }
+
+    size_t capacity() const
+    {
+        return mCapacity;
+    }
+
+    void interrupt()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mInterrupt.store(true, std::memory_order_relaxed);
+        }
+        mCondition.notify_all();
+    }
+
+private:
+    static constexpr int kSpinCount = 64;
+    static constexpr size_t kCacheLineSize = 64;
+
+    struct alignas(kCacheLineSize) Cell
+    {
+        std::atomic<uint64_t> sequence;
+        T data;
+    };
+
+    static size_t RoundUpPowerOfTwo(size_t value)
+    {
+        size_t result = 2;
+        while (result < value)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    void WakeConsumer()
+    {
+        // pairs with the fence in pop_bulk: either the producer sees the waiter
+        // or the waiter sees the element
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (mWaiters.load(std::memory_order_relaxed) > 0)
+        {
+            // the waiter holds the mutex until it waits, so the notify is not lost
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+            }
+            mCondition.notify_one();
+        }
+    }
+
+    const size_t mCapacity;
+    const size_t mMask;
+    std::unique_ptr<Cell[]> mCells;
+    alignas(kCacheLineSize) std::atomic<uint64_t> mEnqueuePos{0};
+    alignas(kCacheLineSize) std::atomic<uint64_t> mDequeuePos{0};
+    alignas(kCacheLineSize) std::atomic<size_t> mWaiters{0};
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::atomic<bool> mInterrupt;
+};
+
+} // namespace util
+
+#endif // _MPMC_QUEUE_H_
@@ -0,0 +1,315 @@
+#ifndef _SPSC_QUEUE_H_
+#define _SPSC_QUEUE_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstddef>
+
+#ifdef __linux__
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "BlockingQueue.h"
+
+namespace util{
+
+/**
+ * bounded queue for exactly one producer thread and one consumer thread.
+ * a lock-free ring, each side owns one index on its own cache line and caches
+ * the other side's index, so it only reads the other index when the cache says
+ * the queue is full or empty.
+ * push and pop spin for a while when the queue is full or empty and then park;
+ * the spin limit adapts to whether spinning paid off last time. every operation
+ * checks whether the other side is parked, the flag has its own cache line that
+ * is only written when a side parks, and on Linux the fence that orders the check
+ * is paid by the parking side with membarrier
+ */
+template<typename T>
+class SpscQueue final
+{
+public:
+    /**
+     * @param capacity rounded up to a power of two
+     */
+    explicit SpscQueue(size_t capacity)
+        : mCapacity(RoundUpPowerOfTwo(capacity)),
+          mMask(mCapacity - 1),
+          mBuffer(new T[mCapacity]),
+          mInterrupt(false)
+    {
+    }
+    ~SpscQueue() = default;
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+    SpscQueue(SpscQueue&&) = delete;
+    SpscQueue& operator=(SpscQueue&&) = delete;
+
+    /**
+     * producer only, return false if the queue is full, val is not moved then
+     */
+    bool try_push(T &&val)
+    {
+        if (!TryPush(val))
+        {
+            return false;
+        }
+        Wake(mConsumerParking);
+        return true;
+    }
+
+    bool try_push(const T &val)
+    {
+        T copy(val);
+        return try_push(std::move(copy));
+    }
+
+    /**
+     * producer only, wait while the queue is full. throw interrupt_error after interrupt
+     */
+    void push(T &&val)
+    {
+        Wait(mProducer, mProducerParking, [&](){ return TryPush(val); });
+        Wake(mConsumerParking);
+    }
+
+    void push(const T &val)
+    {
+        T copy(val);
+        push(std::move(copy));
+    }
+
+    /**
+     * consumer only, return false if the queue is empty
+     */
+    bool try_pop(T &val)
+    {
+        if (!TryPop(val))
+        {
+            return false;
+        }
+        Wake(mProducerParking);
+        return true;
+    }
+
+    /**
+     * consumer only, wait while the queue is empty. throw interrupt_error after interrupt
+     */
+    T pop()
+    {
+        T val;
+        Wait(mConsumer, mConsumerParking, [&](){ return TryPop(val); });
+        Wake(mProducerParking);
+        return val;
+    }
+
+    size_t size() const
+    {
+        size_t tail = mProducer.index.load(std::memory_order_acquire);
+        size_t head = mConsumer.index.load(std::memory_order_acquire);
+        return tail - head;
+    }
+
+    size_t capacity() const
+    {
+        return mCapacity;
+    }
+
+    void interrupt()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mInterrupt.store(true, std::memory_order_relaxed);
+        }
+        mProducerParking.condition.notify_all();
+        mConsumerParking.condition.notify_all();
+    }
+
+private:
+    static constexpr size_t kCacheLineSize = 64;
+    static constexpr size_t kMinSpin = 16;
+    static constexpr size_t kMaxSpin = 4096;
+
+    // state of one side, only written by its own thread
+    struct alignas(kCacheLineSize) Side
+    {
+        std::atomic<size_t> index{0};
+        size_t other_cache = 0; // last seen index of the other side
+        size_t spin_limit = kMaxSpin;
+    };
+
+    // parking of one side, apart from the index the other side keeps writing
+    struct alignas(kCacheLineSize) Parking
+    {
+        std::atomic<bool> waiting{false};
+        std::condition_variable condition;
+    };
+
+    static size_t RoundUpPowerOfTwo(size_t value)
+    {
+        size_t result = 2;
+        while (result < value)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    // the operations without Wake, they run under mMutex in Wait
+    bool TryPush(T &val)
+    {
+        size_t tail = mProducer.index.load(std::memory_order_relaxed);
+        if (tail - mProducer.other_cache >= mCapacity)
+        {
+            mProducer.other_cache = mConsumer.index.load(std::memory_order_acquire);
+            if (tail - mProducer.other_cache >= mCapacity)
+            {
+                return false;
+            }
+        }
+
+        mBuffer[tail & mMask] = std::move(val);
+        mProducer.index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T &val)
+    {
+        size_t head = mConsumer.index.load(std::memory_order_relaxed);
+        if (head == mConsumer.other_cache)
+        {
+            mConsumer.other_cache = mProducer.index.load(std::memory_order_acquire);
+            if (head == mConsumer.other_cache)
+            {
+                return false;
+            }
+        }
+
+        val = std::move(mBuffer[head & mMask]);
+        mConsumer.index.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    static void CpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    /**
+     * true if membarrier can run the fence of Wake on behalf of the waking thread.
+     * decided once, both sides must agree on it
+     */
+    static bool AsymmetricFence()
+    {
+        static const bool asymmetric = []()
+        {
+#if defined(__linux__) && defined(__NR_membarrier)
+            long commands = syscall(__NR_membarrier, MEMBARRIER_CMD_QUERY, 0);
+            return commands > 0 && (commands & MEMBARRIER_CMD_PRIVATE_EXPEDITED) != 0 &&
+                   syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0;
+#else
+            return false;
+#endif
+        }();
+        return asymmetric;
+    }
+
+    // slow side of the pair, a full fence on every running thread of the process
+    static void HeavyFence()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+#if defined(__linux__) && defined(__NR_membarrier)
+        if (AsymmetricFence())
+        {
+            syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+        }
+#endif
+    }
+
+    // fast side of the pair, only a compiler barrier when HeavyFence runs membarrier
+    static void LightFence()
+    {
+        if (AsymmetricFence())
+        {
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        }
+        else
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    /**
+     * spin then park until operation succeeds, the caller wakes the other side after it
+     */
+    template<typename Operation>
+    void Wait(Side &side, Parking &parking, Operation operation)
+    {
+        for (size_t i = 0; i < side.spin_limit; i++)
+        {
+            if (mInterrupt.load(std::memory_order_relaxed))
+            {
+                throw interrupt_error("interrupted");
+            }
+            if (operation())
+            {
+                // spinning paid off, allow longer spins
+                side.spin_limit = std::min(side.spin_limit * 2, kMaxSpin);
+                return;
+            }
+            CpuRelax();
+        }
+        side.spin_limit = std::max(side.spin_limit / 2, kMinSpin);
+
+        bool done = false;
+        std::unique_lock<std::mutex> lock(mMutex);
+        // announce the wait before trying again, see Wake
+        parking.waiting.store(true, std::memory_order_relaxed);
+        HeavyFence();
+        parking.condition.wait(lock, [&](){
+            return (mInterrupt.load(std::memory_order_relaxed) || (done = operation()));
+        });
+        parking.waiting.store(false, std::memory_order_relaxed);
+
+        if (!done)
+        {
+            throw interrupt_error("interrupted");
+        }
+    }
+
+    void Wake(Parking &parking)
+    {
+        // pairs with the fence in Wait: either this side sees the waiter
+        // or the waiter sees the change
+        LightFence();
+        if (parking.waiting.load(std::memory_order_relaxed))
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+            }
+            parking.condition.notify_one();
+        }
+    }
+
+    const size_t mCapacity;
+    const size_t mMask;
+    std::unique_ptr<T[]> mBuffer;
+    Side mProducer; // index is the tail
+    Side mConsumer; // index is the head
+    Parking mProducerParking;
+    Parking mConsumerParking;
+    std::mutex mMutex;
+    std::atomic<bool> mInterrupt;
+};
+
+} // namespace util
+
+#endif // _SPSC_QUEUE_H_
@@ -0,0 +1,472 @@
+#ifndef _WORK_STEALING_POOL_H_
+#define _WORK_STEALING_POOL_H_
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <random>
+#include <cstdint>
+
+#include <boost/asio/execution_context.hpp>
+
+#include "MpmcQueue.h"
+
+namespace util{
+
+/**
+ * Chase-Lev work stealing deque. only the owner pushes and takes at the bottom,
+ * any thread steals at the top. elements must be trivially copyable
+ */
+template<typename T>
+class WorkStealingDeque final
+{
+public:
+    explicit WorkStealingDeque(size_t capacity = 256)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        mArrays.push_back(std::make_unique<Array>(size));
+        mArray.store(mArrays.back().get(), std::memory_order_relaxed);
+    }
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // owner only
+    void push(T val)
+    {
+        int64_t bottom = mBottom.load(std::memory_order_relaxed);
+        int64_t top = mTop.load(std::memory_order_acquire);
+        Array *array = mArray.load(std::memory_order_relaxed);
+        if (bottom - top > static_cast<int64_t>(array->size) - 1)
+        {
+            array = Grow(array, top, bottom);
+        }
+        array->put(bottom, val);
+        // publishes the element to thieves, which load mBottom with acquire
+        mBottom.store(bottom + 1, std::memory_order_release);
+    }
+
+    // owner only, newest element first
+    bool take(T &val)
+    {
+        int64_t bottom = mBottom.load(std::memory_order_relaxed) - 1;
+        Array *array = mArray.load(std::memory_order_relaxed);
+        mBottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = mTop.load(std::memory_order_relaxed);
+
+        bool taken = false;
+        if (top <= bottom)
+        {
+            val = array->get(bottom);
+            taken = true;
+            if (top == bottom)
+            {
+                // the last element, race with thieves
+                taken = mTop.compare_exchange_strong(top, top + 1,
+                            std::memory_order_seq_cst, std::memory_order_relaxed);
+                mBottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+        }
+        else
+        {
+            mBottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return taken;
+    }
+
+    // any thread, oldest element first. false if empty or lost the race
+    bool steal(T &val)
+    {
+        int64_t top = mTop.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = mBottom.load(std::memory_order_acquire);
+        if (top >= bottom)
+        {
+            return false;
+        }
+
+        Array *array = mArray.load(std::memory_order_acquire);
+        T stolen = array->get(top);
+        if (!mTop.compare_exchange_strong(top, top + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return false;
+        }
+        val = stolen;
+        return true;
+    }
+
+    size_t size() const
+    {
+        int64_t bottom = mBottom.load(std::memory_order_relaxed);
+        int64_t top = mTop.load(std::memory_order_relaxed);
+        return (bottom > top) ? static_cast<size_t>(bottom - top) : 0;
+    }
+
+private:
+    struct Array
+    {
+        explicit Array(size_t array_size)
+            : size(array_size),
+              mask(array_size - 1),
+              buffer(new std::atomic<T>[array_size])
+        {
+        }
+
+        T get(int64_t index) const
+        {
+            return buffer[index & mask].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t index, T val)
+        {
+            buffer[index & mask].store(val, std::memory_order_relaxed);
+        }
+
+        const size_t size;
+        const size_t mask;
+        std::unique_ptr<std::atomic<T>[]> buffer;
+    };
+
+    Array* Grow(Array *array, int64_t top, int64_t bottom)
+    {
+        // thieves may still read the old array, it is kept until the deque is destroyed
+        mArrays.push_back(std::make_unique<Array>(array->size * 2));
+        Array *bigger = mArrays.back().get();
+        for (int64_t i = top; i < bottom; i++)
+        {
+            bigger->put(i, array->get(i));
+        }
+        mArray.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    alignas(64) std::atomic<int64_t> mTop{0};
+    alignas(64) std::atomic<int64_t> mBottom{0};
+    std::atomic<Array*> mArray{nullptr};
+    std::vector<std::unique_ptr<Array>> mArrays; // owner only
+};
+
+/**
+ * thread pool with one WorkStealingDeque for each worker. tasks posted from a worker
+ * go to its own deque, tasks from other threads go to a shared injection queue.
+ * an idle worker takes from the injection queue and then steals from the others,
+ * so uneven tasks spread out without a shared lock.
+ * it is also an asio execution context, boost::asio::post(pool.get_executor(), f) works
+ */
+class WorkStealingPool final : public boost::asio::execution_context
+{
+public:
+    /**
+     * @param threads number of worker threads
+     * @param queue_size max tasks in the injection queue
+     */
+    WorkStealingPool(size_t threads, size_t queue_size)
+        : mInjectQueue(queue_size)
+    {
+        for (size_t i = 0; i < threads; i++)
+        {
+            mWorkers.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < threads; i++)
+        {
+            mWorkers[i]->thread = std::thread([this, i](){ Run(i); });
+        }
+    }
+    ~WorkStealingPool()
+    {
+        Stop();
+        shutdown();
+        destroy();
+    }
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    /**
+     * return false if called outside the pool and the injection queue is full
+     */
+    bool Post(std::function<void()> task)
+    {
+        return Submit(MakeTask(std::move(task)), false);
+    }
+
+    /**
+     * stop the workers after their current tasks, queued tasks are dropped
+     */
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop.store(true, std::memory_order_relaxed);
+        }
+        mCondition.notify_all();
+        mInjectQueue.interrupt();
+
+        for (auto &worker : mWorkers)
+        {
+            if (worker->thread.joinable())
+            {
+                worker->thread.join();
+            }
+        }
+
+        // drop the tasks nobody will run
+        TaskBase *task = nullptr;
+        for (auto &worker : mWorkers)
+        {
+            while (worker->deque.steal(task))
+            {
+                delete task;
+            }
+        }
+        while (mInjectQueue.try_pop(task))
+        {
+            delete task;
+        }
+    }
+
+    size_t Size() const
+    {
+        return mWorkers.size();
+    }
+
+    /**
+     * true if the calling thread is a worker of this pool
+     */
+    bool RunningInThisThread() const
+    {
+        return tCurrentPool == this;
+    }
+
+    class executor_type
+    {
+    public:
+        explicit executor_type(WorkStealingPool &pool) noexcept
+            : mPool(&pool)
+        {
+        }
+
+        boost::asio::execution_context& context() const noexcept
+        {
+            return *mPool;
+        }
+
+        // the pool runs until Stop, outstanding work is not tracked
+        void on_work_started() const noexcept {}
+        void on_work_finished() const noexcept {}
+
+        template<typename Function, typename Allocator>
+        void dispatch(Function &&f, const Allocator&) const
+        {
+            if (mPool->RunningInThisThread())
+            {
+                typename std::decay<Function>::type function(std::forward<Function>(f));
+                function();
+                return;
+            }
+            mPool->Submit(MakeTask(std::forward<Function>(f)), true);
+        }
+
+        template<typename Function, typename Allocator>
+        void post(Function &&f, const Allocator&) const
+        {
+            mPool->Submit(MakeTask(std::forward<Function>(f)), true);
+        }
+
+        template<typename Function, typename Allocator>
+        void defer(Function &&f, const Allocator&) const
+        {
+            mPool->Submit(MakeTask(std::forward<Function>(f)), true);
+        }
+
+        friend bool operator==(const executor_type &a, const executor_type &b) noexcept
+        {
+            return a.mPool == b.mPool;
+        }
+
+        friend bool operator!=(const executor_type &a, const executor_type &b) noexcept
+        {
+            return a.mPool != b.mPool;
+        }
+
+    private:
+        WorkStealingPool *mPool;
+    };
+
+    executor_type get_executor() noexcept
+    {
+        return executor_type(*this);
+    }
+
+private:
+    // type erased move-only task, the deques hold raw pointers
+    struct TaskBase
+    {
+        virtual ~TaskBase() = default;
+        virtual void Run() = 0;
+    };
+
+    template<typename Function>
+    struct Task : TaskBase
+    {
+        explicit Task(Function &&f) : function(std::move(f)) {}
+        explicit Task(const Function &f) : function(f) {}
+        void Run() override { function(); }
+        Function function;
+    };
+
+    template<typename Function>
+    static TaskBase* MakeTask(Function &&f)
+    {
+        return new Task<typename std::decay<Function>::type>(std::forward<Function>(f));
+    }
+
+    struct Worker
+    {
+        WorkStealingDeque<TaskBase*> deque;
+        std::thread thread;
+    };
+
+    /**
+     * @param wait wait for room in the injection queue instead of failing
+     */
+    bool Submit(TaskBase *task, bool wait)
+    {
+        if (tCurrentPool == this)
+        {
+            mWorkers[tCurrentIndex]->deque.push(task);
+        }
+        else
+        {
+            while (!mInjectQueue.try_push(std::move(task)))
+            {
+                if (!wait || mStop.load(std::memory_order_relaxed))
+                {
+                    delete task;
+                    return false;
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        WakeWorker();
+        return true;
+    }
+
+    void WakeWorker()
+    {
+        // pairs with the fence in Wait: either the submitter sees the idle worker
+        // or the worker sees the task
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (mIdle.load(std::memory_order_relaxed) > 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+            }
+            mCondition.notify_one();
+        }
+    }
+
+    TaskBase* FindTask(size_t index, std::minstd_rand &random)
+    {
+        TaskBase *task = nullptr;
+        if (mWorkers[index]->deque.take(task) || mInjectQueue.try_pop(task))
+        {
+            return task;
+        }
+
+        // steal from a random victim first, so thieves don't pile on one worker
+        size_t size = mWorkers.size();
+        size_t start = random() % size;
+        for (size_t i = 0; i < size; i++)
+        {
+            size_t victim = (start + i) % size;
+            if (victim != index && mWorkers[victim]->deque.steal(task))
+            {
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    bool HasWork() const
+    {
+        if (mInjectQueue.size() > 0)
+        {
+            return true;
+        }
+        for (const auto &worker : mWorkers)
+        {
+            if (worker->deque.size() > 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mIdle.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        mCondition.wait(lock, [this](){
+            return mStop.load(std::memory_order_relaxed) || HasWork();
+        });
+        mIdle.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void Run(size_t index)
+    {
+        tCurrentPool = this;
+        tCurrentIndex = index;
+        std::minstd_rand random(static_cast<unsigned>(index + 1));
+
+        while (!mStop.load(std::memory_order_relaxed))
+        {
+            TaskBase *task = nullptr;
+            for (int i = 0; i < kSpinCount && task == nullptr; i++)
+            {
+                task = FindTask(index, random);
+            }
+
+            if (task == nullptr)
+            {
+                Wait();
+                continue;
+            }
+
+            std::unique_ptr<TaskBase> holder(task);
+            holder->Run();
+        }
+
+        tCurrentPool = nullptr;
+    }
+
+    static constexpr int kSpinCount = 64;
+
+    static thread_local WorkStealingPool *tCurrentPool;
+    static thread_local size_t tCurrentIndex;
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    MpmcQueue<TaskBase*> mInjectQueue;
+    alignas(64) std::atomic<size_t> mIdle{0};
+    std::atomic<bool> mStop{false};
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+};
+
+inline thread_local WorkStealingPool *WorkStealingPool::tCurrentPool = nullptr;
+inline thread_local size_t WorkStealingPool::tCurrentIndex = 0;
+
+} // namespace util
+
+#endif // _WORK_STEALING_POOL_H_
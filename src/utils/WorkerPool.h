@@ -0,0 +1,145 @@
+#ifndef _WORKER_POOL_H_
+#define _WORKER_POOL_H_
+
+#include <functional>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+
+#include "MpmcQueue.h"
+#include "WorkStealingPool.h"
+
+namespace util{
+
+/**
+ * threads running cpu bound tasks away from the io threads
+ */
+class WorkerPool final
+{
+public:
+    using Task = std::function<void()>;
+
+    enum class Scheduler
+    {
+        SHARED_QUEUE,  // one lock-free MpmcQueue, workers take tasks in batches
+        WORK_STEALING  // a WorkStealingPool, for tasks of very different sizes
+    };
+
+    /**
+     * @param threads number of worker threads
+     * @param queue_size max queued tasks from outside the pool, Post fails when it is full
+     */
+    WorkerPool(size_t threads, size_t queue_size, Scheduler scheduler = Scheduler::SHARED_QUEUE)
+    {
+        if (scheduler == Scheduler::WORK_STEALING)
+        {
+            mWorkStealingPool = std::make_unique<WorkStealingPool>(threads, queue_size);
+            return;
+        }
+
+        mQueue = std::make_unique<MpmcQueue<Task>>(queue_size);
+        for (size_t i = 0; i < threads; i++)
+        {
+            mThreads.emplace_back([this](){ Run(); });
+        }
+    }
+    ~WorkerPool()
+    {
+        Stop();
+    }
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     * return false if the queue is full, the caller should run the task itself
+     */
+    bool Post(Task task)
+    {
+        if (mWorkStealingPool)
+        {
+            return mWorkStealingPool->Post(std::move(task));
+        }
+        return mQueue->try_push(std::move(task));
+    }
+
+    /**
+     * stop the workers after their current tasks, queued tasks are dropped
+     */
+    void Stop()
+    {
+        if (mWorkStealingPool)
+        {
+            mWorkStealingPool->Stop();
+            return;
+        }
+
+        mQueue->interrupt();
+        for (auto &thread : mThreads)
+        {
+            if (thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    size_t Size() const
+    {
+        return mWorkStealingPool ? mWorkStealingPool->Size() : mThreads.size();
+    }
+
+    /**
+     * true if GetExecutor can be used, with Scheduler::WORK_STEALING
+     */
+    bool HasExecutor() const
+    {
+        return static_cast<bool>(mWorkStealingPool);
+    }
+
+    /**
+     * asio executor of the workers, boost::asio::post(pool.GetExecutor(), f) runs f on the pool.
+     * a task posted from a worker goes to that worker's deque and is stolen by idle ones.
+     * throw std::logic_error without Scheduler::WORK_STEALING
+     */
+    WorkStealingPool::executor_type GetExecutor()
+    {
+        if (!mWorkStealingPool)
+        {
+            throw std::logic_error("worker pool has no executor, use the work_stealing scheduler");
+        }
+        return mWorkStealingPool->get_executor();
+    }
+
+private:
+    // small batches, a worker should not hold tasks other idle workers could run
+    static constexpr size_t kBatchSize = 4;
+
+    void Run()
+    {
+        Task tasks[kBatchSize];
+        try
+        {
+            while (true)
+            {
+                size_t count = mQueue->pop_bulk(tasks, kBatchSize);
+                for (size_t i = 0; i < count; i++)
+                {
+                    tasks[i]();
+                    tasks[i] = nullptr;
+                }
+            }
+        }
+        catch (const interrupt_error&)
+        {
+        }
+    }
+
+    std::unique_ptr<MpmcQueue<Task>> mQueue;
+    std::vector<std::thread> mThreads;
+    std::unique_ptr<WorkStealingPool> mWorkStealingPool;
+};
+
+} // namespace util
+
+#endif // _WORKER_POOL_H_
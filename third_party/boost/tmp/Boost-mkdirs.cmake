@@ -0,0 +1,22 @@
+# Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+# file Copyright.txt or https://cmake.org/licensing for details.
+
+cmake_minimum_required(VERSION 3.5)
+
+file(MAKE_DIRECTORY
+  "/root/repo/third_party/boost/src/Boost"
+  "/root/repo/third_party/boost/src/Boost-build"
+  "/root/repo/third_party/boost"
+  "/root/repo/third_party/boost/tmp"
+  "/root/repo/third_party/boost/src/Boost-stamp"
+  "/root/repo/third_party/boost/src"
+  "/root/repo/third_party/boost/src/Boost-stamp"
+)
+
+set(configSubDirs )
+foreach(subDir IN LISTS configSubDirs)
+    file(MAKE_DIRECTORY "/root/repo/third_party/boost/src/Boost-stamp/${subDir}")
+endforeach()
+if(cfgdir)
+  file(MAKE_DIRECTORY "/root/repo/third_party/boost/src/Boost-stamp${cfgdir}") # cfgdir has leading slash
+endif()